@@ -0,0 +1,340 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cmath>
+
+using std::string_literals::operator""s;
+
+// Compile-time range_info
+/*
+	In 01-matrix-addition gpu::range_info is a runtime object, in
+	02-matrix-multiplication its members are static constexpr, but neither is
+	given to the kernel, so the kernel reads its loop counts from
+	item.get_global_range() at run time.
+
+	Here range_info is a policy template parameter of the kernel:
+		gpu::static_range_info<dim, tile>: matrix size and tile size are
+			compile-time constants, the loops have constant trip counts and
+			the inner loop is fully unrolled.
+		gpu::dynamic_range_info: matrix size is known at run time only, the
+			generic fallback. Matrix sizes that are not N * tile are padded
+			and bounds-checked.
+
+	gpu::multiply() switches on the runtime size and picks a specialization
+	for the common sizes.
+*/
+
+// ./prog [gpu|cpu]
+
+namespace gpu
+{
+
+template <int dim__, int tile__>
+class static_range_info
+{
+public:
+	constexpr static const int
+		gdimy = dim__,
+		gdimx = dim__,
+		ldimy = tile__,
+		ldimx = tile__,
+		tile = tile__,
+		tiles = dim__ / tile__,
+		gsize = gdimy * gdimx
+	;
+	constexpr static const bool exact = true;
+	static_assert(dim__ % tile__ == 0);
+};
+
+class dynamic_range_info
+{
+public:
+	constexpr static const int
+		ldimy = 16,
+		ldimx = 16,
+		tile = 16
+	;
+	constexpr static const bool exact = false;
+	const int
+		gdimy,
+		gdimx,
+		tiles,
+		gsize
+	;
+public:
+	dynamic_range_info(int dim__):
+		gdimy{dim__},
+		gdimx{dim__},
+		tiles{(dim__ + tile - 1) / tile},
+		gsize{dim__ * dim__}
+	{
+	}
+};
+
+// m2 = m0 x m1, tiled through local memory. One work-group computes one tile of m2.
+template <typename value_type, typename info_type>
+class multiplication_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+	sycl::local_accessor<value_type, 2> __tile0;
+	sycl::local_accessor<value_type, 2> __tile1;
+	info_type __info;
+public:
+	multiplication_kernel(
+		sycl::buffer<value_type, 2> & m0__,
+		sycl::buffer<value_type, 2> & m1__,
+		sycl::buffer<value_type, 2> & m2__,
+		const info_type & info__,
+		sycl::handler & handler__
+	):
+		__matrix0{m0__, handler__, sycl::read_only},
+		__matrix1{m1__, handler__, sycl::read_only},
+		__matrix2{m2__, handler__, sycl::write_only},
+		__tile0{sycl::range<2>{info_type::tile, info_type::tile}, handler__},
+		__tile1{sycl::range<2>{info_type::tile, info_type::tile}, handler__},
+		__info{info__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		const int gidy = item.get_global_id(0);
+		const int gidx = item.get_global_id(1);
+		const int lidy = item.get_local_id(0);
+		const int lidx = item.get_local_id(1);
+
+		value_type sum = 0;
+
+		// trip count is a constant for static_range_info
+		for (int t=0; t<__info.tiles; ++t)
+		{
+			const int x0 = t * info_type::tile + lidx;
+			const int y1 = t * info_type::tile + lidy;
+			if constexpr (info_type::exact)
+			{
+				__tile0[lidy][lidx] = __matrix0[gidy][x0];
+				__tile1[lidy][lidx] = __matrix1[y1][gidx];
+			}
+			else
+			{
+				__tile0[lidy][lidx] = gidy < __info.gdimy && x0 < __info.gdimx ? __matrix0[gidy][x0] : value_type{0};
+				__tile1[lidy][lidx] = y1 < __info.gdimy && gidx < __info.gdimx ? __matrix1[y1][gidx] : value_type{0};
+			}
+			sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+			#pragma unroll
+			for (int i=0; i<info_type::tile; ++i)
+				sum += __tile0[lidy][i] * __tile1[i][lidx];
+			sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		}
+
+		if constexpr (info_type::exact)
+			__matrix2[gidy][gidx] = sum;
+		else if (gidy < __info.gdimy && gidx < __info.gdimx)
+			__matrix2[gidy][gidx] = sum;
+	}
+};
+
+template <typename value_type, typename info_type>
+sycl::event submit_multiplication(
+	sycl::queue & queue__,
+	sycl::buffer<value_type, 2> & m0__,
+	sycl::buffer<value_type, 2> & m1__,
+	sycl::buffer<value_type, 2> & m2__,
+	const info_type & info__
+)
+{
+	// global range padded to N * tile
+	const std::size_t padded = info__.tiles * info_type::tile;
+	return queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			auto kernel = gpu::multiplication_kernel<value_type, info_type>{m0__, m1__, m2__, info__, handler};
+			handler.parallel_for(
+				sycl::nd_range<2>{
+					sycl::range<2>{padded, padded},
+					sycl::range<2>{info_type::ldimy, info_type::ldimx}
+				},
+				kernel
+			);
+		}
+	);
+}
+
+// m2 = m0 x m1, dim__ x dim__ matrices. Specialized kernels for the common sizes.
+template <typename value_type>
+sycl::event multiply(
+	sycl::queue & queue__,
+	sycl::buffer<value_type, 2> & m0__,
+	sycl::buffer<value_type, 2> & m1__,
+	sycl::buffer<value_type, 2> & m2__,
+	int dim__,
+	bool generic__ = false
+)
+{
+	if (! generic__)
+	{
+		switch (dim__)
+		{
+		case 4:
+			return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::static_range_info<4, 2>{});
+		case 16:
+			return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::static_range_info<16, 8>{});
+		case 32:
+			return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::static_range_info<32, 16>{});
+		case 64:
+			return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::static_range_info<64, 16>{});
+		case 128:
+			return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::static_range_info<128, 16>{});
+		case 256:
+			return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::static_range_info<256, 16>{});
+		case 512:
+			return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::static_range_info<512, 16>{});
+		case 1024:
+			return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::static_range_info<1024, 16>{});
+		default:
+			break;
+		}
+	}
+	return gpu::submit_multiplication(queue__, m0__, m1__, m2__, gpu::dynamic_range_info{dim__});
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu]"};
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v} :
+		sycl::queue{sycl::gpu_selector_v};
+
+// the 4 x 4 example of 02-matrix-multiplication
+	{
+		using value_type = int;
+		auto matrix0 = std::vector<value_type>{
+			1,2,3,4,
+			3,2,-1,-2,
+			-2,2,3,2,
+			4,2,-3,4
+		};
+		auto matrix1 = std::vector<value_type>{
+			2,1,-2,-3,
+			3,2,4,5,
+			2,-2,3,4,
+			-2,-3,-3,-4
+		};
+		auto m0_buff = sycl::buffer<value_type, 2>{matrix0.data(), sycl::range<2>{4, 4}};
+		auto m1_buff = sycl::buffer<value_type, 2>{matrix1.data(), sycl::range<2>{4, 4}};
+		auto m2_buff = sycl::buffer<value_type, 2>{sycl::range<2>{4, 4}};
+
+		gpu::multiply(queue, m0_buff, m1_buff, m2_buff, 4);
+
+		auto host_access = m2_buff.get_host_access();
+		for (int j=0; j<4; ++j)
+		{
+			for (int i=0; i<4; ++i)
+				std::cout << std::setw(5) << host_access[j][i];
+			std::cout << std::endl;
+		}
+		std::cout << std::endl;
+	}
+
+// specialized vs generic
+	using value_type = float;
+	std::mt19937 engine{3};
+	std::uniform_real_distribution<value_type> distribution{-1, 1};
+
+	std::cout << std::setw(8) << "dim"
+		<< std::setw(18) << "specialized ms"
+		<< std::setw(18) << "generic ms"
+		<< std::setw(12) << "max error" << std::endl;
+
+	for (int dim: {64, 100, 256, 500, 512, 1024})
+	{
+		std::vector<value_type> matrix0(dim * dim), matrix1(dim * dim);
+		for (auto & x: matrix0)
+			x = distribution(engine);
+		for (auto & x: matrix1)
+			x = distribution(engine);
+
+		auto m0_buff = sycl::buffer<value_type, 2>{matrix0.data(), sycl::range<2>(dim, dim)};
+		auto m1_buff = sycl::buffer<value_type, 2>{matrix1.data(), sycl::range<2>(dim, dim)};
+		auto m2_buff = sycl::buffer<value_type, 2>{sycl::range<2>(dim, dim)};
+
+		auto measure_ms = [&] (bool generic__)
+		{
+			constexpr int repeat = 5;
+			gpu::multiply(queue, m0_buff, m1_buff, m2_buff, dim, generic__).wait();	// warm up
+			auto start = std::chrono::steady_clock::now();
+			for (int i=0; i<repeat; ++i)
+				gpu::multiply(queue, m0_buff, m1_buff, m2_buff, dim, generic__);
+			queue.wait();
+			auto stop = std::chrono::steady_clock::now();
+			return std::chrono::duration<double, std::milli>(stop - start).count() / repeat;
+		};
+
+		// a few rows against the host, after each variant
+		auto max_error = [&] (const std::string & variant__)
+		{
+			const double tolerance = 1e-5 * dim;
+			double error = 0;
+			auto host_access = m2_buff.get_host_access();
+			for (int j=0; j<dim; j+=dim/7)
+			{
+				for (int i=0; i<dim; ++i)
+				{
+					double sum = 0;
+					for (int k=0; k<dim; ++k)
+						sum += matrix0[j*dim+k] * matrix1[k*dim+i];
+					error = std::max(error, std::abs(sum - host_access[j][i]));
+				}
+			}
+			if (error > tolerance)
+				throw std::runtime_error{variant__ + " multiplication, dim " + std::to_string(dim) + ": error " + std::to_string(error)};
+			return error;
+		};
+
+		const double generic_ms = measure_ms(true);
+		const double generic_error = max_error("generic");
+		const double specialized_ms = measure_ms(false);
+		const double specialized_error = max_error("specialized");
+
+		std::cout << std::setw(8) << dim << std::fixed << std::setprecision(3)
+			<< std::setw(18) << specialized_ms
+			<< std::setw(18) << generic_ms
+			<< std::setw(12) << std::scientific << std::setprecision(2) << std::max(generic_error, specialized_error)
+			<< std::defaultfloat << std::endl;
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
+
+// output (the 4 x 4 example):
+/*
+    6  -13    3    3
+   14   15    5    5
+    4  -10   15   20
+    0    2  -21  -30
+
+*/
@@ -0,0 +1,405 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+using std::string_literals::operator""s;
+
+// Strassen matrix multiplication
+/*
+	Large square matrices are split into 2 x 2 blocks, and the product is made
+	of 7 block products instead of 8:
+		M1 = (A11 + A22)(B11 + B22)		C11 = M1 + M4 - M5 + M7
+		M2 = (A21 + A22) B11			C12 = M3 + M5
+		M3 = A11 (B12 - B22)			C21 = M2 + M4
+		M4 = A22 (B21 - B11)			C22 = M1 - M2 + M3 + M6
+		M5 = (A11 + A12) B22
+		M6 = (A21 - A11)(B11 + B12)
+		M7 = (A12 - A22)(B21 + B22)
+
+	Blocks at or below the crossover size use the tiled gemm kernel.
+
+	Blocks are views (pointer + leading dimension) of usm device memory, no
+	copies. Each level needs 3 temporaries (S, T, M) taken from a scratch
+	arena that is allocated once, so the recursion does not allocate.
+	The queue is in-order, so a temporary can be reused as soon as the next
+	command is submitted.
+*/
+
+// ./prog [gpu|cpu] [crossover]
+
+namespace gpu
+{
+
+constexpr auto tile = 16;
+
+using value_type = float;
+
+class matrix_view
+{
+public:
+	value_type * data;
+	int dim;	// dim x dim
+	int ld;		// leading dimension (row pitch)
+public:
+	matrix_view quadrant(int qy__, int qx__) const
+	{
+		const int half = dim / 2;
+		return {data + qy__ * half * ld + qx__ * half, half, ld};
+	}
+};
+
+// c = a x b, dim is N * tile
+class gemm_kernel
+{
+private:
+	matrix_view __a, __b, __c;
+	sycl::local_accessor<value_type, 2> __tile_a;
+	sycl::local_accessor<value_type, 2> __tile_b;
+public:
+	gemm_kernel(const matrix_view & a__, const matrix_view & b__, const matrix_view & c__, sycl::handler & handler__):
+		__a{a__}, __b{b__}, __c{c__},
+		__tile_a{sycl::range<2>{gpu::tile, gpu::tile}, handler__},
+		__tile_b{sycl::range<2>{gpu::tile, gpu::tile}, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		const int gidy = item.get_global_id(0);
+		const int gidx = item.get_global_id(1);
+		const int lidy = item.get_local_id(0);
+		const int lidx = item.get_local_id(1);
+
+		value_type sum = 0;
+		for (int t=0; t<__c.dim; t+=gpu::tile)
+		{
+			__tile_a[lidy][lidx] = __a.data[gidy * __a.ld + t + lidx];
+			__tile_b[lidy][lidx] = __b.data[(t + lidy) * __b.ld + gidx];
+			sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+			#pragma unroll
+			for (int i=0; i<gpu::tile; ++i)
+				sum += __tile_a[lidy][i] * __tile_b[i][lidx];
+			sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		}
+		__c.data[gidy * __c.ld + gidx] = sum;
+	}
+};
+
+// out = a + sign * b
+class combine_kernel
+{
+private:
+	matrix_view __a, __b, __out;
+	value_type __sign;
+public:
+	combine_kernel(const matrix_view & a__, const matrix_view & b__, value_type sign__, const matrix_view & out__):
+		__a{a__}, __b{b__}, __out{out__}, __sign{sign__}
+	{
+	}
+public:
+	void operator()(sycl::item<2> item) const
+	{
+		const int y = item.get_id(0);
+		const int x = item.get_id(1);
+		__out.data[y * __out.ld + x] = __a.data[y * __a.ld + x] + __sign * __b.data[y * __b.ld + x];
+	}
+};
+
+// out = alpha * m (assign), or out += alpha * m
+class accumulate_kernel
+{
+private:
+	matrix_view __m, __out;
+	value_type __alpha;
+	bool __assign;
+public:
+	accumulate_kernel(const matrix_view & m__, value_type alpha__, bool assign__, const matrix_view & out__):
+		__m{m__}, __out{out__}, __alpha{alpha__}, __assign{assign__}
+	{
+	}
+public:
+	void operator()(sycl::item<2> item) const
+	{
+		const int y = item.get_id(0);
+		const int x = item.get_id(1);
+		value_type & out = __out.data[y * __out.ld + x];
+		const value_type value = __alpha * __m.data[y * __m.ld + x];
+		out = __assign ? value : out + value;
+	}
+};
+
+// Stack of device memory: allocate() bumps the top, release() pops back to a mark.
+class scratch_arena
+{
+private:
+	sycl::queue & __queue;
+	value_type * __data;
+	std::size_t __capacity;
+	std::size_t __top = 0;
+public:
+	scratch_arena(const scratch_arena &) = delete;
+	scratch_arena & operator=(const scratch_arena &) = delete;
+	scratch_arena(sycl::queue & queue__, std::size_t capacity__):
+		__queue{queue__},
+		__data{sycl::malloc_device<value_type>(std::max<std::size_t>(capacity__, 1), queue__)},
+		__capacity{capacity__}
+	{
+		if (__data == nullptr)
+			throw std::runtime_error{"scratch_arena: can not allocate device memory."};
+	}
+	~scratch_arena()
+	{
+		__queue.wait();
+		sycl::free(__data, __queue);
+	}
+public:
+	value_type * allocate(std::size_t size__)
+	{
+		if (__top + size__ > __capacity)
+			throw std::runtime_error{"scratch_arena: out of memory."};
+		value_type * out = __data + __top;
+		__top += size__;
+		return out;
+	}
+	std::size_t mark() const
+	{
+		return __top;
+	}
+	void release(std::size_t mark__)
+	{
+		__top = mark__;
+	}
+	// Elements needed by gpu::strassen() for a dim__ x dim__ product.
+	static std::size_t required(int dim__, int crossover__)
+	{
+		std::size_t size = 0;
+		for (std::size_t n=dim__; n>static_cast<std::size_t>(crossover__); n/=2)
+			size += 3 * (n / 2) * (n / 2);
+		return size;
+	}
+};
+
+void gemm(sycl::queue & queue__, const matrix_view & a__, const matrix_view & b__, const matrix_view & c__)
+{
+	queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			auto kernel = gpu::gemm_kernel{a__, b__, c__, handler};
+			handler.parallel_for(
+				sycl::nd_range<2>{
+					sycl::range<2>(c__.dim, c__.dim),
+					sycl::range<2>{gpu::tile, gpu::tile}
+				},
+				kernel
+			);
+		}
+	);
+}
+
+void combine(sycl::queue & queue__, const matrix_view & a__, const matrix_view & b__, value_type sign__, const matrix_view & out__)
+{
+	queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			handler.parallel_for(sycl::range<2>(out__.dim, out__.dim), gpu::combine_kernel{a__, b__, sign__, out__});
+		}
+	);
+}
+
+void accumulate(sycl::queue & queue__, const matrix_view & m__, value_type alpha__, bool assign__, const matrix_view & out__)
+{
+	queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			handler.parallel_for(sycl::range<2>(out__.dim, out__.dim), gpu::accumulate_kernel{m__, alpha__, assign__, out__});
+		}
+	);
+}
+
+// c = a x b. queue__ must be in-order.
+void strassen(
+	sycl::queue & queue__,
+	gpu::scratch_arena & arena__,
+	const matrix_view & a__,
+	const matrix_view & b__,
+	const matrix_view & c__,
+	int crossover__
+)
+{
+	if (c__.dim <= crossover__ || c__.dim % (2 * gpu::tile) != 0)
+	{
+		gpu::gemm(queue__, a__, b__, c__);
+		return;
+	}
+
+	const auto mark = arena__.mark();
+	const int half = c__.dim / 2;
+	const matrix_view s{arena__.allocate(half * half), half, half};
+	const matrix_view t{arena__.allocate(half * half), half, half};
+	const matrix_view m{arena__.allocate(half * half), half, half};
+
+	const auto a11 = a__.quadrant(0, 0), a12 = a__.quadrant(0, 1), a21 = a__.quadrant(1, 0), a22 = a__.quadrant(1, 1);
+	const auto b11 = b__.quadrant(0, 0), b12 = b__.quadrant(0, 1), b21 = b__.quadrant(1, 0), b22 = b__.quadrant(1, 1);
+	const auto c11 = c__.quadrant(0, 0), c12 = c__.quadrant(0, 1), c21 = c__.quadrant(1, 0), c22 = c__.quadrant(1, 1);
+
+	auto product = [&] (const matrix_view & x__, const matrix_view & y__)
+	{
+		gpu::strassen(queue__, arena__, x__, y__, m, crossover__);
+	};
+
+	// M1
+	gpu::combine(queue__, a11, a22, 1, s);
+	gpu::combine(queue__, b11, b22, 1, t);
+	product(s, t);
+	gpu::accumulate(queue__, m, 1, true, c11);
+	gpu::accumulate(queue__, m, 1, true, c22);
+	// M2
+	gpu::combine(queue__, a21, a22, 1, s);
+	product(s, b11);
+	gpu::accumulate(queue__, m, 1, true, c21);
+	gpu::accumulate(queue__, m, -1, false, c22);
+	// M3
+	gpu::combine(queue__, b12, b22, -1, t);
+	product(a11, t);
+	gpu::accumulate(queue__, m, 1, true, c12);
+	gpu::accumulate(queue__, m, 1, false, c22);
+	// M4
+	gpu::combine(queue__, b21, b11, -1, t);
+	product(a22, t);
+	gpu::accumulate(queue__, m, 1, false, c11);
+	gpu::accumulate(queue__, m, 1, false, c21);
+	// M5
+	gpu::combine(queue__, a11, a12, 1, s);
+	product(s, b22);
+	gpu::accumulate(queue__, m, -1, false, c11);
+	gpu::accumulate(queue__, m, 1, false, c12);
+	// M6
+	gpu::combine(queue__, a21, a11, -1, s);
+	gpu::combine(queue__, b11, b12, 1, t);
+	product(s, t);
+	gpu::accumulate(queue__, m, 1, false, c22);
+	// M7
+	gpu::combine(queue__, a12, a22, -1, s);
+	gpu::combine(queue__, b21, b22, 1, t);
+	product(s, t);
+	gpu::accumulate(queue__, m, 1, false, c11);
+
+	arena__.release(mark);
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu] [crossover]"};
+	const int crossover = argc > 2 ? std::stoi(argv[2]) : 256;
+	if (crossover < gpu::tile)
+		throw std::runtime_error{"crossover must be >= "s + std::to_string(gpu::tile)};
+
+	const sycl::property_list properties{sycl::property::queue::in_order{}};
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v, properties} :
+		sycl::queue{sycl::gpu_selector_v, properties};
+
+	std::mt19937 engine{5};
+	std::uniform_real_distribution<gpu::value_type> distribution{-1, 1};
+
+	std::cout << "crossover: " << crossover << std::endl;
+	std::cout << std::setw(8) << "dim"
+		<< std::setw(16) << "classical ms"
+		<< std::setw(16) << "strassen ms"
+		<< std::setw(18) << "classical error"
+		<< std::setw(18) << "strassen error" << std::endl;
+
+	for (int dim: {256, 512, 1024, 2048})
+	{
+		const std::size_t size = static_cast<std::size_t>(dim) * dim;
+		std::vector<gpu::value_type> matrix0(size), matrix1(size), result(size);
+		for (auto & x: matrix0)
+			x = distribution(engine);
+		for (auto & x: matrix1)
+			x = distribution(engine);
+
+		gpu::value_type * m0 = sycl::malloc_device<gpu::value_type>(size, queue);
+		gpu::value_type * m1 = sycl::malloc_device<gpu::value_type>(size, queue);
+		gpu::value_type * m2 = sycl::malloc_device<gpu::value_type>(size, queue);
+		if (! m0 || ! m1 || ! m2)
+			throw std::runtime_error{"Can not allocate device memory."};
+		queue.memcpy(m0, matrix0.data(), size * sizeof(gpu::value_type));
+		queue.memcpy(m1, matrix1.data(), size * sizeof(gpu::value_type));
+
+		const gpu::matrix_view a{m0, dim, dim}, b{m1, dim, dim}, c{m2, dim, dim};
+		gpu::scratch_arena arena{queue, gpu::scratch_arena::required(dim, crossover)};
+
+		auto measure_ms = [&] (auto && run__)
+		{
+			constexpr int repeat = 3;
+			run__();	// warm up
+			queue.wait();
+			auto start = std::chrono::steady_clock::now();
+			for (int i=0; i<repeat; ++i)
+				run__();
+			queue.wait();
+			auto stop = std::chrono::steady_clock::now();
+			return std::chrono::duration<double, std::milli>(stop - start).count() / repeat;
+		};
+
+		// largest error against a double precision host product, over a few rows
+		auto max_error = [&]
+		{
+			queue.memcpy(result.data(), m2, size * sizeof(gpu::value_type)).wait();
+			double error = 0;
+			for (int j=0; j<dim; j+=dim/8)
+			{
+				for (int i=0; i<dim; ++i)
+				{
+					double sum = 0;
+					for (int k=0; k<dim; ++k)
+						sum += static_cast<double>(matrix0[j*dim+k]) * matrix1[k*dim+i];
+					error = std::max(error, std::abs(sum - result[j*dim+i]));
+				}
+			}
+			return error;
+		};
+
+		const double classical_ms = measure_ms([&] { gpu::gemm(queue, a, b, c); });
+		const double classical_error = max_error();
+		const double strassen_ms = measure_ms([&] { gpu::strassen(queue, arena, a, b, c, crossover); });
+		const double strassen_error = max_error();
+
+		std::cout << std::setw(8) << dim << std::fixed << std::setprecision(3)
+			<< std::setw(16) << classical_ms
+			<< std::setw(16) << strassen_ms
+			<< std::scientific << std::setprecision(2)
+			<< std::setw(18) << classical_error
+			<< std::setw(18) << strassen_error
+			<< std::defaultfloat << std::endl;
+
+		sycl::free(m0, queue);
+		sycl::free(m1, queue);
+		sycl::free(m2, queue);
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
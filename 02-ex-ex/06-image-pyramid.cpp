@@ -0,0 +1,491 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <SFML/Graphics.hpp>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <numbers>
+
+using std::string_literals::operator""s;
+
+// Image pyramid
+/*
+	All levels of the pyramid (level 0 is the input image, each next level is
+	2x smaller) live in one buffer, one level after another.
+
+	Each level is made from the previous one by a 2x downscale kernel: a
+	work-group of 16 x 16 output pixels loads the (32 + 2 * apron)^2 source
+	pixels it needs into local memory once, then filters from there.
+		box:		2 x 2 average, apron 0
+		lanczos:	lanczos-2, 8 taps, apron 3
+
+	The small levels (at most tail_size pixels) would each pay a full kernel
+	launch for a few pixels, so they are all made by one single work-group
+	kernel, with a group barrier between levels.
+
+	gpu::upscale_kernel is the 2x bilinear way back up.
+*/
+
+// ./prog 03-q3.jpg pyramid [box|lanczos]
+// writes pyramid-1.png, pyramid-2.png, ... and pyramid-up.png (level 1 upscaled)
+
+namespace gpu
+{
+constexpr auto block_size = 16u;
+constexpr auto tail_size = 64u * 64u;
+constexpr auto benchmark_runs = 50;
+
+using color_type = std::array<unsigned char, 3>;
+
+class image_type
+{
+private:
+	std::vector<gpu::color_type> __image;
+	unsigned int __width, __height;
+public:
+	image_type() = delete;
+	image_type(const std::string & filename__)
+	{
+		sf::Image * image = new sf::Image;
+		if (! image->loadFromFile(filename__))
+		{
+			delete image;
+			throw std::runtime_error{"Can not load image: "s + filename__};
+		}
+
+		{
+			auto [w, h] = image->getSize();
+			__width = w;
+			__height = h;
+		}
+
+		{
+			for (unsigned int y=0; y<__height; ++y)
+			{
+				for (unsigned int x=0; x<__width; ++x)
+				{
+					const auto & color = image->getPixel(x, y);
+					__image.push_back({color.r, color.g, color.b});
+				}
+			}
+		}
+
+		delete image;
+	}
+public:
+	std::vector<gpu::color_type> & image()
+	{
+		return __image;
+	}
+	unsigned int width() const
+	{
+		return __width;
+	}
+	unsigned int height() const
+	{
+		return __height;
+	}
+};
+
+// Where a level is in the pyramid buffer.
+class level_info
+{
+public:
+	std::size_t offset;
+	unsigned int width, height;
+};
+
+std::vector<gpu::level_info> make_levels(unsigned int width__, unsigned int height__)
+{
+	std::vector<gpu::level_info> levels{{0, width__, height__}};
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		const auto & last = levels.back();
+		levels.push_back({
+			last.offset + std::size_t{last.width} * last.height,
+			std::max(last.width / 2, 1u),
+			std::max(last.height / 2, 1u)
+		});
+	}
+	return levels;
+}
+
+// Separable 2x downscale weights: source pixel 2x + t - apron for t in [0, taps)
+template <int apron__>
+std::array<float, 2 + 2 * apron__> make_weights()
+{
+	std::array<float, 2 + 2 * apron__> weights;
+	float sum = 0;
+	for (int t=0; t<static_cast<int>(weights.size()); ++t)
+	{
+		// distance to the output pixel center, in output pixels
+		const double d = (t - apron__ - 0.5) / 2;
+		auto sinc = [] (double x__)
+		{
+			return x__ == 0 ? 1.0 : std::sin(std::numbers::pi * x__) / (std::numbers::pi * x__);
+		};
+		weights[t] = apron__ == 0 ? 1.0f : static_cast<float>(sinc(d) * sinc(d / 2));
+		sum += weights[t];
+	}
+	for (auto & w: weights)
+		w /= sum;
+	return weights;
+}
+
+inline unsigned char to_byte(float value__)
+{
+	return static_cast<unsigned char>(sycl::clamp(value__ + 0.5f, 0.0f, 255.0f));
+}
+
+template <int apron__>
+class downscale_kernel
+{
+public:
+	constexpr static const int
+		taps = 2 + 2 * apron__,
+		tile = 2 * gpu::block_size + 2 * apron__
+	;
+private:
+	sycl::accessor<gpu::color_type, 1, sycl::access_mode::read_write> __pyramid;
+	sycl::local_accessor<gpu::color_type, 2> __lm;
+	gpu::level_info __src, __dst;
+	std::array<float, taps> __weights;
+public:
+	downscale_kernel(
+		sycl::buffer<gpu::color_type, 1> & pyramid__,
+		const gpu::level_info & src__,
+		const gpu::level_info & dst__,
+		const std::array<float, taps> & weights__,
+		sycl::handler & handler__
+	):
+		__pyramid{pyramid__, handler__, sycl::read_write},
+		__lm{sycl::range<2>{tile, tile}, handler__},
+		__src{src__},
+		__dst{dst__},
+		__weights{weights__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		const int gidy = item.get_global_id(0);
+		const int gidx = item.get_global_id(1);
+		const int lidy = item.get_local_id(0);
+		const int lidx = item.get_local_id(1);
+
+		// first source pixel of the tile
+		const int sy0 = 2 * static_cast<int>(item.get_group(0) * gpu::block_size) - apron__;
+		const int sx0 = 2 * static_cast<int>(item.get_group(1) * gpu::block_size) - apron__;
+		const int last_y = __src.height - 1;
+		const int last_x = __src.width - 1;
+
+		// load the tile, clamped to the edges of the source level
+		for (int i=lidy*gpu::block_size+lidx; i<tile*tile; i+=gpu::block_size*gpu::block_size)
+		{
+			const int ty = i / tile;
+			const int tx = i % tile;
+			const int sy = sycl::clamp(sy0 + ty, 0, last_y);
+			const int sx = sycl::clamp(sx0 + tx, 0, last_x);
+			__lm[ty][tx] = __pyramid[__src.offset + sy * __src.width + sx];
+		}
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		if (gidy >= static_cast<int>(__dst.height) || gidx >= static_cast<int>(__dst.width))
+			return;
+
+		float sum[3] = {0, 0, 0};
+		for (int ty=0; ty<taps; ++ty)
+		{
+			for (int tx=0; tx<taps; ++tx)
+			{
+				const float w = __weights[ty] * __weights[tx];
+				const gpu::color_type & color = __lm[2*lidy+ty][2*lidx+tx];
+				for (int c=0; c<3; ++c)
+					sum[c] += w * color[c];
+			}
+		}
+		__pyramid[__dst.offset + gidy * __dst.width + gidx] = {gpu::to_byte(sum[0]), gpu::to_byte(sum[1]), gpu::to_byte(sum[2])};
+	}
+};
+
+// One work-group makes all levels from first__ + 1 to the last, reading global memory.
+template <int apron__>
+class pyramid_tail_kernel
+{
+public:
+	constexpr static const int taps = 2 + 2 * apron__;
+	constexpr static const int max_levels = 32;
+private:
+	sycl::accessor<gpu::color_type, 1, sycl::access_mode::read_write> __pyramid;
+	std::array<gpu::level_info, max_levels> __levels;
+	int __first, __count;
+	std::array<float, taps> __weights;
+public:
+	pyramid_tail_kernel(
+		sycl::buffer<gpu::color_type, 1> & pyramid__,
+		const std::vector<gpu::level_info> & levels__,
+		int first__,
+		const std::array<float, taps> & weights__,
+		sycl::handler & handler__
+	):
+		__pyramid{pyramid__, handler__, sycl::read_write},
+		__first{first__},
+		__count{static_cast<int>(levels__.size())},
+		__weights{weights__}
+	{
+		if (levels__.size() > max_levels)
+			throw std::runtime_error{"pyramid_tail_kernel: too many levels"};
+		std::copy(levels__.begin(), levels__.end(), __levels.begin());
+	}
+public:
+	void operator()(sycl::nd_item<1> item) const
+	{
+		const int lid = item.get_local_id(0);
+		const int lsize = item.get_local_range(0);
+		for (int level=__first+1; level<__count; ++level)
+		{
+			const auto & src = __levels[level-1];
+			const auto & dst = __levels[level];
+			for (int i=lid; i<static_cast<int>(dst.width*dst.height); i+=lsize)
+			{
+				const int y = i / dst.width;
+				const int x = i % dst.width;
+				float sum[3] = {0, 0, 0};
+				for (int ty=0; ty<taps; ++ty)
+				{
+					const int sy = sycl::clamp(2*y + ty - apron__, 0, static_cast<int>(src.height) - 1);
+					for (int tx=0; tx<taps; ++tx)
+					{
+						const int sx = sycl::clamp(2*x + tx - apron__, 0, static_cast<int>(src.width) - 1);
+						const float w = __weights[ty] * __weights[tx];
+						const gpu::color_type color = __pyramid[src.offset + sy * src.width + sx];
+						for (int c=0; c<3; ++c)
+							sum[c] += w * color[c];
+					}
+				}
+				__pyramid[dst.offset + i] = {gpu::to_byte(sum[0]), gpu::to_byte(sum[1]), gpu::to_byte(sum[2])};
+			}
+			// the next level reads this one
+			sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		}
+	}
+};
+
+// 2x bilinear upscale of one pyramid level into out_buffer__.
+class upscale_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 1, sycl::access_mode::read> __pyramid;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	gpu::level_info __src;
+public:
+	upscale_kernel(
+		sycl::buffer<gpu::color_type, 1> & pyramid__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const gpu::level_info & src__,
+		sycl::handler & handler__
+	):
+		__pyramid{pyramid__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__src{src__}
+	{
+	}
+public:
+	void operator()(sycl::item<2> item) const
+	{
+		const int y = item.get_id(0);
+		const int x = item.get_id(1);
+		const float fy = sycl::clamp((y + 0.5f) / 2 - 0.5f, 0.0f, __src.height - 1.0f);
+		const float fx = sycl::clamp((x + 0.5f) / 2 - 0.5f, 0.0f, __src.width - 1.0f);
+		const int y0 = static_cast<int>(fy), x0 = static_cast<int>(fx);
+		const int y1 = sycl::min(y0 + 1, static_cast<int>(__src.height) - 1);
+		const int x1 = sycl::min(x0 + 1, static_cast<int>(__src.width) - 1);
+		const float wy = fy - y0, wx = fx - x0;
+
+		auto at = [&] (int yy__, int xx__) -> const gpu::color_type &
+		{
+			return __pyramid[__src.offset + yy__ * __src.width + xx__];
+		};
+		gpu::color_type out;
+		for (int c=0; c<3; ++c)
+		{
+			const float top = at(y0, x0)[c] * (1 - wx) + at(y0, x1)[c] * wx;
+			const float bottom = at(y1, x0)[c] * (1 - wx) + at(y1, x1)[c] * wx;
+			out[c] = gpu::to_byte(top * (1 - wy) + bottom * wy);
+		}
+		__output[y][x] = out;
+	}
+};
+
+inline std::size_t round_up(std::size_t value__, std::size_t multiple__)
+{
+	return (value__ + multiple__ - 1) / multiple__ * multiple__;
+}
+
+// Submit the whole chain of downscale kernels on an in-order queue. Returns the last event.
+template <int apron__>
+sycl::event build_pyramid(
+	sycl::queue & queue__,
+	sycl::buffer<gpu::color_type, 1> & pyramid__,
+	const std::vector<gpu::level_info> & levels__
+)
+{
+	const auto weights = gpu::make_weights<apron__>();
+	sycl::event last;
+	std::size_t level = 1;
+	for (; level<levels__.size(); ++level)
+	{
+		const auto & dst = levels__[level];
+		if (std::size_t{dst.width} * dst.height <= gpu::tail_size)
+			break;
+		last = queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				auto kernel = gpu::downscale_kernel<apron__>{pyramid__, levels__[level-1], dst, weights, handler};
+				handler.parallel_for(
+					sycl::nd_range<2>{
+						sycl::range<2>{gpu::round_up(dst.height, gpu::block_size), gpu::round_up(dst.width, gpu::block_size)},
+						sycl::range<2>{gpu::block_size, gpu::block_size}
+					},
+					kernel
+				);
+			}
+		);
+	}
+	if (level < levels__.size())
+	{
+		last = queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				auto kernel = gpu::pyramid_tail_kernel<apron__>{pyramid__, levels__, static_cast<int>(level) - 1, weights, handler};
+				handler.parallel_for(
+					sycl::nd_range<1>{
+						sycl::range<1>{gpu::block_size * gpu::block_size},
+						sycl::range<1>{gpu::block_size * gpu::block_size}
+					},
+					kernel
+				);
+			}
+		);
+	}
+	return last;
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	if (argc != 3 && argc != 4)
+		throw std::runtime_error{""s + argv[0] + " <input image> <output prefix> [box|lanczos]"};
+	if (! std::filesystem::exists(argv[1]))
+		throw std::runtime_error{"Input image does not exist: "s + argv[1]};
+	const std::string filter = argc == 4 ? argv[3] : "box";
+	if (filter != "box" && filter != "lanczos")
+		throw std::runtime_error{"Unknown filter: "s + filter};
+
+	gpu::image_type input_image{argv[1]};
+	std::cout << "Input image size: " << input_image.width() << " x " << input_image.height() << std::endl;
+
+	const auto levels = gpu::make_levels(input_image.width(), input_image.height());
+	const std::size_t total = levels.back().offset + std::size_t{levels.back().width} * levels.back().height;
+
+	// level 0 is the input image, the rest is written by the kernels
+	std::vector<gpu::color_type> pyramid(total);
+	std::copy(input_image.image().begin(), input_image.image().end(), pyramid.begin());
+	auto pyramid_buffer = sycl::buffer<gpu::color_type, 1>{pyramid.data(), sycl::range<1>{total}};
+
+	sycl::queue queue{sycl::gpu_selector_v, sycl::property_list{sycl::property::queue::in_order{}}};
+
+	auto build = [&]
+	{
+		return filter == "box" ?
+			gpu::build_pyramid<0>(queue, pyramid_buffer, levels) :
+			gpu::build_pyramid<3>(queue, pyramid_buffer, levels);
+	};
+
+	build().wait();	// warm up
+	auto start = std::chrono::steady_clock::now();
+	for (int i=0; i<gpu::benchmark_runs; ++i)
+		build();
+	queue.wait();
+	auto stop = std::chrono::steady_clock::now();
+	const double seconds = std::chrono::duration<double>(stop - start).count();
+	std::cout << "Levels: " << levels.size() - 1 << ", filter: " << filter << std::endl;
+	std::cout << std::fixed << std::setprecision(1)
+		<< gpu::benchmark_runs / seconds << " pyramids/s, "
+		<< gpu::benchmark_runs * (levels.size() - 1) / seconds << " levels/s" << std::endl;
+
+	// level 1 back up to level 0 size
+	auto up_buffer = sycl::buffer<gpu::color_type, 2>{sycl::range<2>{input_image.height(), input_image.width()}};
+	queue.submit(
+		[&] (sycl::handler & handler)
+		{
+			handler.parallel_for(
+				sycl::range<2>{input_image.height(), input_image.width()},
+				gpu::upscale_kernel{pyramid_buffer, up_buffer, levels[1], handler}
+			);
+		}
+	);
+
+	auto save = [] (const std::string & filename__, unsigned int width__, unsigned int height__, auto && pixel__)
+	{
+		sf::Image image;
+		image.create(width__, height__);
+		for (unsigned int j=0; j<height__; ++j)
+		{
+			for (unsigned int i=0; i<width__; ++i)
+			{
+				gpu::color_type color = pixel__(j, i);
+				image.setPixel(i, j, sf::Color{color[0], color[1], color[2]});
+			}
+		}
+		if (! image.saveToFile(filename__))
+			throw std::runtime_error{"Save output image to file "s + filename__ + " error."};
+	};
+
+	{
+		auto host_access = pyramid_buffer.get_host_access();
+		for (std::size_t level=1; level<levels.size(); ++level)
+		{
+			const auto & info = levels[level];
+			save(
+				argv[2] + "-"s + std::to_string(level) + ".png",
+				info.width,
+				info.height,
+				[&] (unsigned int j__, unsigned int i__)
+				{
+					return host_access[info.offset + j__ * info.width + i__];
+				}
+			);
+		}
+	}
+	{
+		auto host_access = up_buffer.get_host_access();
+		save(
+			argv[2] + "-up.png"s,
+			input_image.width(),
+			input_image.height(),
+			[&] (unsigned int j__, unsigned int i__)
+			{
+				return host_access[j__][i__];
+			}
+		);
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
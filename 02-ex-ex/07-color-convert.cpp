@@ -0,0 +1,592 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <SFML/Graphics.hpp>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+using std::string_literals::operator""s;
+
+// Color conversion
+/*
+	Pixel operations on gpu::color_type, each is a small class with
+		color_type operator()(const color_type &) const
+	so it can run in a kernel by itself (convert_kernel), or inside the piece
+	rotate kernel of 03-image-piece-rotate (rotate_convert_kernel), which
+	makes a rotate + convert job one pass over the image instead of two.
+
+	ycbcr / gray conversions take the matrix as a template parameter (bt601,
+	bt709) and the arithmetic: fixed_point (Q16 integers, byte path) or
+	floating_point.
+
+	Operations:
+		gray			rgb to luma
+		ycbcr			rgb to ycbcr (full range, as jpeg)
+		ycbcr-rgb		rgb to ycbcr and back
+		hsv			rgb to hsv and back, with a hue shift
+		gamma			gamma 2.2 through a 256 entry lut
+		lut3d			17^3 3d lut (warm tone), trilinear
+*/
+
+// ./prog 03-q3.jpg output.jpg [gray|ycbcr|ycbcr-rgb|hsv|gamma|lut3d]
+
+namespace gpu
+{
+constexpr auto area_size = 256u;
+constexpr auto benchmark_runs = 20;
+
+using color_type = std::array<unsigned char, 3>;
+
+class image_type
+{
+private:
+	std::vector<gpu::color_type> __image;
+	unsigned int __width, __height;
+public:
+	image_type() = delete;
+	image_type(const std::string & filename__)
+	{
+		sf::Image * image = new sf::Image;
+		if (! image->loadFromFile(filename__))
+		{
+			delete image;
+			throw std::runtime_error{"Can not load image: "s + filename__};
+		}
+
+		{
+			auto [w, h] = image->getSize();
+			__width = w;
+			__height = h;
+		}
+
+		{
+			for (unsigned int y=0; y<__height; ++y)
+			{
+				for (unsigned int x=0; x<__width; ++x)
+				{
+					const auto & color = image->getPixel(x, y);
+					__image.push_back({color.r, color.g, color.b});
+				}
+			}
+		}
+
+		delete image;
+	}
+public:
+	std::vector<gpu::color_type> & image()
+	{
+		return __image;
+	}
+	unsigned int width() const
+	{
+		return __width;
+	}
+	unsigned int height() const
+	{
+		return __height;
+	}
+};
+
+enum class arithmetic
+{
+	fixed_point,
+	floating_point
+};
+
+// luma weights of red and blue
+class bt601
+{
+public:
+	constexpr static const double kr = 0.299, kb = 0.114;
+};
+
+class bt709
+{
+public:
+	constexpr static const double kr = 0.2126, kb = 0.0722;
+};
+
+template <typename matrix_type>
+class ycbcr_coefficients
+{
+public:
+	constexpr static const double
+		kr = matrix_type::kr,
+		kb = matrix_type::kb,
+		kg = 1 - kr - kb,
+		// forward
+		y_r = kr, y_g = kg, y_b = kb,
+		cb_r = -kr / (2 * (1 - kb)), cb_g = -kg / (2 * (1 - kb)), cb_b = 0.5,
+		cr_r = 0.5, cr_g = -kg / (2 * (1 - kr)), cr_b = -kb / (2 * (1 - kr)),
+		// inverse
+		r_cr = 2 * (1 - kr),
+		g_cb = -2 * (1 - kb) * kb / kg,
+		g_cr = -2 * (1 - kr) * kr / kg,
+		b_cb = 2 * (1 - kb)
+	;
+	// Q16
+	constexpr static int fixed(double c__)
+	{
+		return static_cast<int>(c__ * 65536 + (c__ < 0 ? -0.5 : 0.5));
+	}
+};
+
+inline unsigned char clamp_byte(int value__)
+{
+	return static_cast<unsigned char>(sycl::clamp(value__, 0, 255));
+}
+
+inline unsigned char clamp_byte(float value__)
+{
+	return static_cast<unsigned char>(sycl::clamp(value__ + 0.5f, 0.0f, 255.0f));
+}
+
+template <typename matrix_type, gpu::arithmetic arithmetic__ = gpu::arithmetic::fixed_point>
+class rgb_to_ycbcr
+{
+	using k = gpu::ycbcr_coefficients<matrix_type>;
+public:
+	color_type operator()(const color_type & c__) const
+	{
+		const int r = c__[0], g = c__[1], b = c__[2];
+		if constexpr (arithmetic__ == gpu::arithmetic::fixed_point)
+		{
+			constexpr int half = 1 << 15, offset = 128 << 16;
+			return {
+				gpu::clamp_byte((k::fixed(k::y_r) * r + k::fixed(k::y_g) * g + k::fixed(k::y_b) * b + half) >> 16),
+				gpu::clamp_byte((k::fixed(k::cb_r) * r + k::fixed(k::cb_g) * g + k::fixed(k::cb_b) * b + offset + half) >> 16),
+				gpu::clamp_byte((k::fixed(k::cr_r) * r + k::fixed(k::cr_g) * g + k::fixed(k::cr_b) * b + offset + half) >> 16)
+			};
+		}
+		else
+		{
+			return {
+				gpu::clamp_byte(float(k::y_r) * r + float(k::y_g) * g + float(k::y_b) * b),
+				gpu::clamp_byte(float(k::cb_r) * r + float(k::cb_g) * g + float(k::cb_b) * b + 128),
+				gpu::clamp_byte(float(k::cr_r) * r + float(k::cr_g) * g + float(k::cr_b) * b + 128)
+			};
+		}
+	}
+};
+
+template <typename matrix_type, gpu::arithmetic arithmetic__ = gpu::arithmetic::fixed_point>
+class ycbcr_to_rgb
+{
+	using k = gpu::ycbcr_coefficients<matrix_type>;
+public:
+	color_type operator()(const color_type & c__) const
+	{
+		const int y = c__[0], cb = c__[1] - 128, cr = c__[2] - 128;
+		if constexpr (arithmetic__ == gpu::arithmetic::fixed_point)
+		{
+			constexpr int half = 1 << 15;
+			const int y16 = y << 16;
+			return {
+				gpu::clamp_byte((y16 + k::fixed(k::r_cr) * cr + half) >> 16),
+				gpu::clamp_byte((y16 + k::fixed(k::g_cb) * cb + k::fixed(k::g_cr) * cr + half) >> 16),
+				gpu::clamp_byte((y16 + k::fixed(k::b_cb) * cb + half) >> 16)
+			};
+		}
+		else
+		{
+			return {
+				gpu::clamp_byte(y + float(k::r_cr) * cr),
+				gpu::clamp_byte(y + float(k::g_cb) * cb + float(k::g_cr) * cr),
+				gpu::clamp_byte(y + float(k::b_cb) * cb)
+			};
+		}
+	}
+};
+
+template <typename matrix_type, gpu::arithmetic arithmetic__ = gpu::arithmetic::fixed_point>
+class rgb_to_gray
+{
+public:
+	color_type operator()(const color_type & c__) const
+	{
+		const unsigned char y = gpu::rgb_to_ycbcr<matrix_type, arithmetic__>{}(c__)[0];
+		return {y, y, y};
+	}
+};
+
+// rgb to hsv, shift the hue by hue_shift__ (0..1 is one turn), and back.
+class hsv_hue_shift
+{
+private:
+	float __hue_shift;
+public:
+	hsv_hue_shift(float hue_shift__):
+		__hue_shift{hue_shift__}
+	{
+	}
+public:
+	color_type operator()(const color_type & c__) const
+	{
+		const float r = c__[0] / 255.0f, g = c__[1] / 255.0f, b = c__[2] / 255.0f;
+		const float max = sycl::fmax(r, sycl::fmax(g, b));
+		const float min = sycl::fmin(r, sycl::fmin(g, b));
+		const float delta = max - min;
+
+		// hsv, h in [0, 6)
+		float h = 0;
+		if (delta > 0)
+		{
+			if (max == r)
+				h = (g - b) / delta;
+			else if (max == g)
+				h = (b - r) / delta + 2;
+			else
+				h = (r - g) / delta + 4;
+		}
+		const float s = max > 0 ? delta / max : 0;
+		const float v = max;
+
+		h = h + 6 * __hue_shift;
+		h = h - 6 * sycl::floor(h / 6);
+
+		// back to rgb
+		const int sector = static_cast<int>(h) % 6;
+		const float f = h - sycl::floor(h);
+		const float p = v * (1 - s), q = v * (1 - s * f), t = v * (1 - s * (1 - f));
+		float out[3];
+		switch (sector)
+		{
+		case 0: out[0] = v; out[1] = t; out[2] = p; break;
+		case 1: out[0] = q; out[1] = v; out[2] = p; break;
+		case 2: out[0] = p; out[1] = v; out[2] = t; break;
+		case 3: out[0] = p; out[1] = q; out[2] = v; break;
+		case 4: out[0] = t; out[1] = p; out[2] = v; break;
+		default: out[0] = v; out[1] = p; out[2] = q; break;
+		}
+		return {gpu::clamp_byte(out[0] * 255), gpu::clamp_byte(out[1] * 255), gpu::clamp_byte(out[2] * 255)};
+	}
+};
+
+// Per channel 256 entry lut, kept in the kernel object.
+class lut1d
+{
+private:
+	std::array<unsigned char, 256> __table;
+public:
+	lut1d(const std::array<unsigned char, 256> & table__):
+		__table{table__}
+	{
+	}
+	static lut1d gamma(double gamma__)
+	{
+		std::array<unsigned char, 256> table;
+		for (int i=0; i<256; ++i)
+			table[i] = static_cast<unsigned char>(std::lround(255 * std::pow(i / 255.0, 1 / gamma__)));
+		return lut1d{table};
+	}
+public:
+	color_type operator()(const color_type & c__) const
+	{
+		return {__table[c__[0]], __table[c__[1]], __table[c__[2]]};
+	}
+};
+
+// size^3 rgb lut in a buffer, trilinear, Q8 weights per axis.
+class lut3d
+{
+public:
+	constexpr static const int size = 17;
+private:
+	sycl::accessor<gpu::color_type, 3, sycl::access_mode::read> __table;
+public:
+	lut3d(sycl::buffer<gpu::color_type, 3> & table__, sycl::handler & handler__):
+		__table{table__, handler__, sycl::read_only}
+	{
+	}
+	// A warm tone table.
+	static std::vector<gpu::color_type> warm_table()
+	{
+		std::vector<gpu::color_type> table;
+		for (int r=0; r<size; ++r)
+		{
+			for (int g=0; g<size; ++g)
+			{
+				for (int b=0; b<size; ++b)
+				{
+					const double scale = 255.0 / (size - 1);
+					table.push_back({
+						static_cast<unsigned char>(std::min(255.0, r * scale * 1.08 + 6)),
+						static_cast<unsigned char>(g * scale),
+						static_cast<unsigned char>(b * scale * 0.88)
+					});
+				}
+			}
+		}
+		return table;
+	}
+public:
+	color_type operator()(const color_type & c__) const
+	{
+		// position in the lut, Q8
+		int index[3], weight[3];
+		for (int i=0; i<3; ++i)
+		{
+			const int position = c__[i] * (size - 1) * 256 / 255;
+			index[i] = sycl::min(position >> 8, size - 2);
+			weight[i] = position - (index[i] << 8);
+		}
+		int sum[3] = {0, 0, 0};
+		for (int corner=0; corner<8; ++corner)
+		{
+			const int dr = corner >> 2 & 1, dg = corner >> 1 & 1, db = corner & 1;
+			const int w =
+				(dr ? weight[0] : 256 - weight[0]) *
+				(dg ? weight[1] : 256 - weight[1]) *
+				(db ? weight[2] : 256 - weight[2]);
+			const gpu::color_type & value = __table[index[0] + dr][index[1] + dg][index[2] + db];
+			for (int i=0; i<3; ++i)
+				sum[i] += (w >> 8) * value[i];
+		}
+		return {
+			gpu::clamp_byte((sum[0] + (1 << 15)) >> 16),
+			gpu::clamp_byte((sum[1] + (1 << 15)) >> 16),
+			gpu::clamp_byte((sum[2] + (1 << 15)) >> 16)
+		};
+	}
+};
+
+// second__(first__(c))
+template <typename first_type, typename second_type>
+class compose
+{
+private:
+	first_type __first;
+	second_type __second;
+public:
+	compose(const first_type & first__, const second_type & second__):
+		__first{first__}, __second{second__}
+	{
+	}
+public:
+	color_type operator()(const color_type & c__) const
+	{
+		return __second(__first(c__));
+	}
+};
+
+template <typename operation_type>
+class convert_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	operation_type __operation;
+public:
+	convert_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const operation_type & operation__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__operation{operation__}
+	{
+	}
+public:
+	void operator()(sycl::item<2> item) const
+	{
+		__output[item.get_id()] = __operation(__input[item.get_id()]);
+	}
+};
+
+// The piece rotate of 03-image-piece-rotate, converting each pixel on the way.
+template <typename operation_type>
+class rotate_convert_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	operation_type __operation;
+public:
+	rotate_convert_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const operation_type & operation__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__operation{operation__}
+	{
+	}
+public:
+	void operator()(sycl::item<2> item) const
+	{
+		auto gidy = item.get_id(0);
+		auto gidx = item.get_id(1);
+
+		auto y_start = static_cast<unsigned int>(gidy/gpu::area_size) * gpu::area_size;
+		auto x_start = static_cast<unsigned int>(gidx/gpu::area_size) * gpu::area_size;
+
+		auto src_gidy = gidx - x_start + y_start;
+		auto src_gidx = gidy - y_start + x_start;
+
+		__output[gidy][gidx] = __operation(__input[src_gidy][src_gidx]);
+	}
+};
+
+// Plain piece rotate, the first pass of the two pass version.
+class rotate_operation
+{
+public:
+	color_type operator()(const color_type & c__) const
+	{
+		return c__;
+	}
+};
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	if (argc != 3 && argc != 4)
+		throw std::runtime_error{""s + argv[0] + " <input image> <output image> [gray|ycbcr|ycbcr-rgb|hsv|gamma|lut3d]"};
+	if (! std::filesystem::exists(argv[1]))
+		throw std::runtime_error{"Input image does not exist: "s + argv[1]};
+	const std::string operation = argc == 4 ? argv[3] : "gray";
+
+	gpu::image_type input_image{argv[1]};
+	std::cout << "Input image size: " << input_image.width() << " x " << input_image.height() << std::endl;
+
+	if (input_image.width() % gpu::area_size != 0 || input_image.height() % gpu::area_size != 0)
+		throw std::runtime_error{"Input image size must be N * "s + std::to_string(gpu::area_size) + " , (N > 0, N is int)"};
+
+	const sycl::range<2> range{input_image.height(), input_image.width()};
+	auto input_buffer = sycl::buffer<gpu::color_type, 2>{input_image.image().data(), range};
+	auto temp_buffer = sycl::buffer<gpu::color_type, 2>{range};
+	auto output_buffer = sycl::buffer<gpu::color_type, 2>{range};
+
+	auto lut3d_table = gpu::lut3d::warm_table();
+	auto lut3d_buffer = sycl::buffer<gpu::color_type, 3>{
+		lut3d_table.data(),
+		sycl::range<3>{gpu::lut3d::size, gpu::lut3d::size, gpu::lut3d::size}
+	};
+
+	sycl::queue queue{sycl::gpu_selector_v};
+
+	// Call function__ with the selected operation. lut3d needs the handler.
+	auto with_operation = [&] (sycl::handler & handler__, auto && function__)
+	{
+		if (operation == "gray")
+			function__(gpu::rgb_to_gray<gpu::bt601>{});
+		else if (operation == "ycbcr")
+			function__(gpu::rgb_to_ycbcr<gpu::bt601>{});
+		else if (operation == "ycbcr-rgb")
+			function__(gpu::compose{gpu::rgb_to_ycbcr<gpu::bt709>{}, gpu::ycbcr_to_rgb<gpu::bt709>{}});
+		else if (operation == "hsv")
+			function__(gpu::hsv_hue_shift{0.25f});
+		else if (operation == "gamma")
+			function__(gpu::lut1d::gamma(2.2));
+		else if (operation == "lut3d")
+			function__(gpu::lut3d{lut3d_buffer, handler__});
+		else
+			throw std::runtime_error{"Unknown operation: "s + operation};
+	};
+
+	auto two_pass = [&]
+	{
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(range, gpu::rotate_convert_kernel{input_buffer, temp_buffer, gpu::rotate_operation{}, handler});
+			}
+		);
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				with_operation(
+					handler,
+					[&] (const auto & operation__)
+					{
+						handler.parallel_for(range, gpu::convert_kernel{temp_buffer, output_buffer, operation__, handler});
+					}
+				);
+			}
+		);
+	};
+
+	auto fused = [&]
+	{
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				with_operation(
+					handler,
+					[&] (const auto & operation__)
+					{
+						handler.parallel_for(range, gpu::rotate_convert_kernel{input_buffer, output_buffer, operation__, handler});
+					}
+				);
+			}
+		);
+	};
+
+	auto measure_ms = [&] (auto && run__)
+	{
+		run__();	// warm up
+		queue.wait();
+		auto start = std::chrono::steady_clock::now();
+		for (int i=0; i<gpu::benchmark_runs; ++i)
+			run__();
+		queue.wait();
+		auto stop = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(stop - start).count() / gpu::benchmark_runs;
+	};
+
+	std::cout << "Operation: " << operation << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+
+	const double two_pass_ms = measure_ms(two_pass);
+	std::vector<gpu::color_type> two_pass_result(range.size());
+	{
+		auto host_access = output_buffer.get_host_access();
+		std::copy(host_access.begin(), host_access.end(), two_pass_result.begin());
+	}
+	std::cout << "rotate, then convert: " << two_pass_ms << " ms" << std::endl;
+
+	const double fused_ms = measure_ms(fused);
+	std::cout << "rotate + convert:     " << fused_ms << " ms" << std::endl;
+
+	auto host_access = output_buffer.get_host_access();
+	if (! std::equal(host_access.begin(), host_access.end(), two_pass_result.begin()))
+		throw std::runtime_error{"Fused and two pass results are not the same."};
+
+	sf::Image output_image;
+	output_image.create(input_image.width(), input_image.height());
+
+	for (unsigned int j=0; j<input_image.height(); ++j)
+	{
+		for (unsigned int i=0; i<input_image.width(); ++i)
+		{
+			gpu::color_type color = host_access[j][i];
+			output_image.setPixel(i, j, sf::Color{color[0], color[1], color[2]});
+		}
+	}
+
+	if (! output_image.saveToFile(argv[2]))
+		throw std::runtime_error{"Save output image to file "s + argv[2] + " error."};
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
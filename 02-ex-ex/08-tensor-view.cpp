@@ -0,0 +1,499 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <numeric>
+#include <cmath>
+
+using std::string_literals::operator""s;
+
+// Tensor view
+/*
+	gpu::tensor_view<storage_type, rank> is a shape, strides and an offset
+	over some storage. Slicing, transposing and broadcasting only make a new
+	view of the same storage, nothing is copied.
+
+	storage_type is:
+		value_type *				usm memory, usable in kernels as is
+		sycl::buffer<value_type, 1> *		a buffer, on the host only;
+							gpu::bind() turns it into a view
+							over an accessor in a command group
+		sycl::accessor<value_type, 1, mode>	the bound view, in kernels
+
+	The elementwise, addition and multiplication kernels of 01-basic-sycl and
+	02-ex-ex are written against views, so they run on sub-matrices, transposed
+	matrices and image regions in place.
+*/
+
+// ./prog [gpu|cpu]
+
+namespace gpu
+{
+
+template <typename storage_type, int rank__>
+class tensor_view
+{
+public:
+	using index_type = std::ptrdiff_t;
+	using shape_type = std::array<index_type, rank__>;
+	constexpr static const int rank = rank__;
+private:
+	storage_type __storage;
+	shape_type __shape;
+	shape_type __strides;
+	index_type __offset;
+public:
+	tensor_view(storage_type storage__, const shape_type & shape__, const shape_type & strides__, index_type offset__ = 0):
+		__storage{storage__},
+		__shape{shape__},
+		__strides{strides__},
+		__offset{offset__}
+	{
+	}
+	// row-major, contiguous
+	tensor_view(storage_type storage__, const shape_type & shape__):
+		tensor_view{storage__, shape__, contiguous_strides(shape__)}
+	{
+	}
+public:
+	static shape_type contiguous_strides(const shape_type & shape__)
+	{
+		shape_type strides;
+		index_type stride = 1;
+		for (int d=rank__-1; d>=0; --d)
+		{
+			strides[d] = stride;
+			stride *= shape__[d];
+		}
+		return strides;
+	}
+	const storage_type & storage() const
+	{
+		return __storage;
+	}
+	const shape_type & shape() const
+	{
+		return __shape;
+	}
+	index_type shape(int dim__) const
+	{
+		return __shape[dim__];
+	}
+	const shape_type & strides() const
+	{
+		return __strides;
+	}
+	index_type offset() const
+	{
+		return __offset;
+	}
+	index_type size() const
+	{
+		index_type size = 1;
+		for (int d=0; d<rank__; ++d)
+			size *= __shape[d];
+		return size;
+	}
+public:
+	decltype(auto) operator[](const shape_type & index__) const
+	{
+		index_type position = __offset;
+		for (int d=0; d<rank__; ++d)
+			position += index__[d] * __strides[d];
+		return __storage[position];
+	}
+	template <typename ... index_types>
+	decltype(auto) operator()(index_types ... index__) const
+	{
+		static_assert(sizeof...(index_types) == rank__);
+		return (* this)[shape_type{static_cast<index_type>(index__)...}];
+	}
+	// row-major linear index to index
+	shape_type unravel(index_type linear__) const
+	{
+		shape_type index;
+		for (int d=rank__-1; d>=0; --d)
+		{
+			index[d] = linear__ % __shape[d];
+			linear__ /= __shape[d];
+		}
+		return index;
+	}
+public:
+	// elements [start__, stop__) of dimension dim__, every step__ one
+	tensor_view slice(int dim__, index_type start__, index_type stop__, index_type step__ = 1) const
+	{
+		if (start__ < 0 || stop__ > __shape[dim__] || start__ > stop__ || step__ <= 0)
+			throw std::out_of_range{"tensor_view::slice"};
+		tensor_view out = * this;
+		out.__offset += start__ * __strides[dim__];
+		out.__shape[dim__] = (stop__ - start__ + step__ - 1) / step__;
+		out.__strides[dim__] *= step__;
+		return out;
+	}
+	tensor_view transpose(int dim0__ = 0, int dim1__ = 1) const
+	{
+		tensor_view out = * this;
+		std::swap(out.__shape[dim0__], out.__shape[dim1__]);
+		std::swap(out.__strides[dim0__], out.__strides[dim1__]);
+		return out;
+	}
+	// numpy rules: dimensions are matched from the last one, a dimension of 1 is repeated
+	template <std::size_t new_rank__>
+	tensor_view<storage_type, new_rank__> broadcast_to(const std::array<index_type, new_rank__> & shape__) const
+	{
+		static_assert(new_rank__ >= std::size_t{rank__});
+		std::array<index_type, new_rank__> strides{};
+		for (int d=0; d<rank__; ++d)
+		{
+			const int nd = d + static_cast<int>(new_rank__) - rank__;
+			if (__shape[d] == shape__[nd])
+				strides[nd] = __strides[d];
+			else if (__shape[d] == 1)
+				strides[nd] = 0;
+			else
+				throw std::invalid_argument{"tensor_view::broadcast_to: shapes do not match"};
+		}
+		return {__storage, shape__, strides, __offset};
+	}
+	// the same view over other storage
+	template <typename other_storage_type>
+	tensor_view<other_storage_type, rank__> with_storage(other_storage_type storage__) const
+	{
+		return {storage__, __shape, __strides, __offset};
+	}
+};
+
+template <typename value_type, int rank>
+using usm_tensor = gpu::tensor_view<value_type *, rank>;
+
+template <typename value_type, int rank>
+using buffer_tensor = gpu::tensor_view<sycl::buffer<value_type, 1> *, rank>;
+
+// usm views need no binding
+template <typename value_type, int rank, typename mode_tag>
+gpu::usm_tensor<value_type, rank> bind(const gpu::usm_tensor<value_type, rank> & view__, sycl::handler &, mode_tag)
+{
+	return view__;
+}
+
+// buffer views get an accessor of the command group
+template <typename value_type, int rank, typename mode_tag>
+auto bind(const gpu::buffer_tensor<value_type, rank> & view__, sycl::handler & handler__, mode_tag tag__)
+{
+	return view__.with_storage(sycl::accessor{* view__.storage(), handler__, tag__});
+}
+
+template <typename in_view_type, typename out_view_type, typename function_type>
+class elementwise_kernel
+{
+private:
+	in_view_type __input;
+	out_view_type __output;
+	function_type __function;
+public:
+	elementwise_kernel(const in_view_type & input__, const out_view_type & output__, const function_type & function__):
+		__input{input__}, __output{output__}, __function{function__}
+	{
+	}
+public:
+	void operator()(sycl::item<1> item) const
+	{
+		const auto index = __output.unravel(item.get_id(0));
+		__output[index] = __function(__input[index]);
+	}
+};
+
+template <typename view0_type, typename view1_type, typename view2_type>
+class addition_kernel
+{
+private:
+	view0_type __matrix0;
+	view1_type __matrix1;
+	view2_type __matrix2;
+public:
+	addition_kernel(const view0_type & m0__, const view1_type & m1__, const view2_type & m2__):
+		__matrix0{m0__}, __matrix1{m1__}, __matrix2{m2__}
+	{
+	}
+public:
+	void operator()(sycl::item<1> item) const
+	{
+		const auto index = __matrix2.unravel(item.get_id(0));
+		__matrix2[index] = __matrix0[index] + __matrix1[index];
+	}
+};
+
+template <typename view0_type, typename view1_type, typename view2_type>
+class multiplication_kernel
+{
+private:
+	view0_type __matrix0;
+	view1_type __matrix1;
+	view2_type __matrix2;
+public:
+	multiplication_kernel(const view0_type & m0__, const view1_type & m1__, const view2_type & m2__):
+		__matrix0{m0__}, __matrix1{m1__}, __matrix2{m2__}
+	{
+	}
+public:
+	void operator()(sycl::item<2> item) const
+	{
+		const auto j = item.get_id(0);
+		const auto i = item.get_id(1);
+		auto sum = __matrix0(j, 0) * __matrix1(0, i);
+		for (std::ptrdiff_t k=1; k<__matrix0.shape(1); ++k)
+			sum += __matrix0(j, k) * __matrix1(k, i);
+		__matrix2(j, i) = sum;
+	}
+};
+
+// out = function__(in), in is broadcast to the shape of out
+template <typename in_view_type, typename out_view_type, typename function_type>
+sycl::event elementwise(sycl::queue & queue__, const in_view_type & in__, const out_view_type & out__, const function_type & function__)
+{
+	return queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			auto in = gpu::bind(in__.broadcast_to(out__.shape()), handler, sycl::read_only);
+			auto out = gpu::bind(out__, handler, sycl::write_only);
+			handler.parallel_for(
+				sycl::range<1>(out__.size()),
+				gpu::elementwise_kernel{in, out, function__}
+			);
+		}
+	);
+}
+
+// m2 = m0 + m1, m0 and m1 are broadcast to the shape of m2
+template <typename view0_type, typename view1_type, typename view2_type>
+sycl::event add(sycl::queue & queue__, const view0_type & m0__, const view1_type & m1__, const view2_type & m2__)
+{
+	return queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			auto m0 = gpu::bind(m0__.broadcast_to(m2__.shape()), handler, sycl::read_only);
+			auto m1 = gpu::bind(m1__.broadcast_to(m2__.shape()), handler, sycl::read_only);
+			auto m2 = gpu::bind(m2__, handler, sycl::write_only);
+			handler.parallel_for(sycl::range<1>(m2__.size()), gpu::addition_kernel{m0, m1, m2});
+		}
+	);
+}
+
+// m2 = m0 x m1, rank 2 views
+template <typename view0_type, typename view1_type, typename view2_type>
+sycl::event multiply(sycl::queue & queue__, const view0_type & m0__, const view1_type & m1__, const view2_type & m2__)
+{
+	if (m0__.shape(1) != m1__.shape(0) || m2__.shape(0) != m0__.shape(0) || m2__.shape(1) != m1__.shape(1))
+		throw std::invalid_argument{"gpu::multiply: shapes do not match"};
+	return queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			auto m0 = gpu::bind(m0__, handler, sycl::read_only);
+			auto m1 = gpu::bind(m1__, handler, sycl::read_only);
+			auto m2 = gpu::bind(m2__, handler, sycl::write_only);
+			handler.parallel_for(sycl::range<2>(m2__.shape(0), m2__.shape(1)), gpu::multiplication_kernel{m0, m1, m2});
+		}
+	);
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu]"};
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v} :
+		sycl::queue{sycl::gpu_selector_v};
+
+	auto print = [] (const auto & view__)
+	{
+		for (std::ptrdiff_t j=0; j<view__.shape(0); ++j)
+		{
+			for (std::ptrdiff_t i=0; i<view__.shape(1); ++i)
+				std::cout << std::setw(8) << view__(j, i);
+			std::cout << std::endl;
+		}
+		std::cout << std::endl;
+	};
+
+// buffer views: the 4 x 4 examples of 01-matrix-addition and 02-matrix-multiplication
+	{
+		using value_type = int;
+		std::vector<value_type> matrix0{
+			1,2,3,4,
+			3,2,-1,-2,
+			-2,2,3,2,
+			4,2,-3,4
+		};
+		std::vector<value_type> matrix1{
+			2,1,-2,-3,
+			3,2,4,5,
+			2,-2,3,4,
+			-2,-3,-3,-4
+		};
+		std::vector<value_type> sum(16), product(16);
+		{
+			auto m0_buff = sycl::buffer<value_type, 1>{matrix0.data(), sycl::range<1>{16}};
+			auto m1_buff = sycl::buffer<value_type, 1>{matrix1.data(), sycl::range<1>{16}};
+			auto sum_buff = sycl::buffer<value_type, 1>{sum.data(), sycl::range<1>{16}};
+			auto product_buff = sycl::buffer<value_type, 1>{product.data(), sycl::range<1>{16}};
+
+			const gpu::buffer_tensor<value_type, 2> m0{&m0_buff, {4, 4}};
+			const gpu::buffer_tensor<value_type, 2> m1{&m1_buff, {4, 4}};
+			gpu::add(queue, m0, m1, gpu::buffer_tensor<value_type, 2>{&sum_buff, {4, 4}});
+			gpu::multiply(queue, m0, m1, gpu::buffer_tensor<value_type, 2>{&product_buff, {4, 4}});
+		}
+		std::cout << "m0 + m1 =\n";
+		print(gpu::usm_tensor<value_type, 2>{sum.data(), {4, 4}});
+		std::cout << "m0 x m1 =\n";
+		print(gpu::usm_tensor<value_type, 2>{product.data(), {4, 4}});
+	}
+
+// usm views: sub-matrices, transposes, broadcasting, no copies
+	{
+		using value_type = float;
+		constexpr std::ptrdiff_t dim = 8;
+		value_type * big = sycl::malloc_shared<value_type>(dim * dim, queue);
+		value_type * out = sycl::malloc_shared<value_type>(dim * dim, queue);
+		value_type * row = sycl::malloc_shared<value_type>(dim, queue);
+		if (! big || ! out || ! row)
+			throw std::runtime_error{"Can not allocate usm memory."};
+		std::iota(big, big + dim * dim, 1.0f);
+		std::iota(row, row + dim, 100.0f);
+
+		const gpu::usm_tensor<value_type, 2> matrix{big, {dim, dim}};
+
+		// rows 2..5 x columns 1..4 of matrix, times its own transpose
+		const auto block = matrix.slice(0, 2, 5).slice(1, 1, 4);
+		gpu::usm_tensor<value_type, 2> result{out, {3, 3}};
+		gpu::multiply(queue, block, block.transpose(), result).wait();
+		std::cout << "block x block^T =\n";
+		print(result);
+
+		// every other column of matrix + row, broadcast over the rows
+		const auto columns = matrix.slice(1, 0, dim, 2);
+		const gpu::usm_tensor<value_type, 1> row_view{row, {dim}};
+		gpu::usm_tensor<value_type, 2> result2{out, {dim, dim / 2}};
+		gpu::add(queue, columns, row_view.slice(0, 0, dim, 2), result2).wait();
+		std::cout << "matrix[:, ::2] + row[::2] =\n";
+		print(result2);
+
+		// sqrt of the transposed bottom-right quarter
+		gpu::usm_tensor<value_type, 2> result3{out, {dim / 2, dim / 2}};
+		gpu::elementwise(
+			queue,
+			matrix.slice(0, dim / 2, dim).slice(1, dim / 2, dim).transpose(),
+			result3,
+			[] (value_type x__)
+			{
+				return sycl::sqrt(x__);
+			}
+		).wait();
+		std::cout << std::setprecision(4) << "sqrt(matrix[4:, 4:]^T) =\n";
+		print(result3);
+
+		sycl::free(big, queue);
+		sycl::free(out, queue);
+		sycl::free(row, queue);
+	}
+
+// an image region: height x width x 3 bytes, brighten one region per channel
+	{
+		constexpr std::ptrdiff_t height = 64, width = 64;
+		std::vector<unsigned char> image(height * width * 3, 100);
+		std::vector<float> gain{1.5f, 1.0f, 0.5f};
+		{
+			auto image_buff = sycl::buffer<unsigned char, 1>{image.data(), sycl::range<1>(image.size())};
+			const gpu::buffer_tensor<unsigned char, 3> view{&image_buff, {height, width, 3}};
+			const auto region = view.slice(0, 16, 48).slice(1, 8, 40);
+
+			// one pass: out and in are the same region, read_write through one accessor
+			queue.submit(
+				[&] (sycl::handler & handler)
+				{
+					auto pixels = gpu::bind(region, handler, sycl::read_write);
+					handler.parallel_for(
+						sycl::range<1>(region.size()),
+						[=, g = std::array<float, 3>{gain[0], gain[1], gain[2]}] (sycl::item<1> item)
+						{
+							const auto index = pixels.unravel(item.get_id(0));
+							pixels[index] = static_cast<unsigned char>(sycl::min(pixels[index] * g[index[2]], 255.0f));
+						}
+					);
+				}
+			);
+		}
+
+		// check on the host
+		for (std::ptrdiff_t y=0; y<height; ++y)
+		{
+			for (std::ptrdiff_t x=0; x<width; ++x)
+			{
+				for (int c=0; c<3; ++c)
+				{
+					const bool inside = y >= 16 && y < 48 && x >= 8 && x < 40;
+					const auto expected = static_cast<unsigned char>(inside ? 100 * gain[c] : 100);
+					if (image[(y * width + x) * 3 + c] != expected)
+						throw std::runtime_error{"Wrong pixel in the image region example."};
+				}
+			}
+		}
+		std::cout << "image region: ok" << std::endl;
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
+
+// output:
+/*
+m0 + m1 =
+       3       3       1       1
+       6       4       3       3
+       0       0       6       6
+       2      -1      -6       0
+
+m0 x m1 =
+       6     -13       3       3
+      14      15       5       5
+       4     -10      15      20
+       0       2     -21     -30
+
+block x block^T =
+    1085    1541    1997
+    1541    2189    2837
+    1997    2837    3677
+
+matrix[:, ::2] + row[::2] =
+     101     105     109     113
+     109     113     117     121
+     117     121     125     129
+     125     129     133     137
+     133     137     141     145
+     141     145     149     153
+     149     153     157     161
+     157     161     165     169
+
+sqrt(matrix[4:, 4:]^T) =
+   6.083   6.708    7.28    7.81
+   6.164   6.782   7.348   7.874
+   6.245   6.856   7.416   7.937
+   6.325   6.928   7.483       8
+
+image region: ok
+*/
@@ -0,0 +1,527 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <numbers>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+using std::string_literals::operator""s;
+
+// Streaming audio: fir filter and fft
+/*
+	The input (16 bit pcm wav, or raw 16 bit little endian stereo 44100 Hz)
+	is read chunk_frames frames at a time, so memory stays the same for any
+	length of audio. For each chunk:
+		+ deinterleave to one float row per channel, after the last
+		  taps - 1 samples of the previous chunk (overlap-save)
+		+ fir low pass: a work-group loads the taps and its input samples
+		  into local memory, then each work-item makes one output sample
+		+ interleave back to 16 bit and append to the output wav
+		+ fft of the filtered chunk (radix-4 stockham stages, one radix-2
+		  stage if needed), power spectrum summed over all chunks
+
+	The strongest frequencies of the input and the realtime factor (seconds of
+	audio per second of processing) are printed at the end.
+
+	Runs on the cpu device.
+*/
+
+// ./prog input.wav output.wav [cutoff Hz]
+
+namespace gpu
+{
+
+constexpr auto chunk_frames = 4096u;		// also the fft size
+constexpr auto taps = 127u;
+constexpr auto history = taps - 1;
+constexpr auto block_size = 256u;
+
+static_assert(gpu::chunk_frames % gpu::block_size == 0);
+static_assert((gpu::chunk_frames & (gpu::chunk_frames - 1)) == 0);
+
+class complex_type
+{
+public:
+	float re, im;
+};
+
+class audio_format
+{
+public:
+	unsigned int channels = 2;
+	unsigned int sample_rate = 44100;
+};
+
+// 16 bit pcm wav or raw pcm, read in chunks.
+class pcm_reader
+{
+private:
+	std::ifstream __file;
+	gpu::audio_format __format;
+	std::uint64_t __remaining = 0;		// bytes of sample data left
+private:
+	template <typename type>
+	type read_le()
+	{
+		unsigned char bytes[sizeof(type)];
+		if (! __file.read(reinterpret_cast<char *>(bytes), sizeof(type)))
+			throw std::runtime_error{"Unexpected end of wav header."};
+		std::uint64_t value = 0;
+		for (std::size_t i=0; i<sizeof(type); ++i)
+			value |= std::uint64_t{bytes[i]} << (8 * i);
+		return static_cast<type>(value);
+	}
+public:
+	pcm_reader(const std::string & filename__):
+		__file{filename__, std::ios::binary}
+	{
+		if (! __file)
+			throw std::runtime_error{"Can not open audio file: "s + filename__};
+
+		if (std::filesystem::path{filename__}.extension() != ".wav")
+		{
+			__remaining = std::filesystem::file_size(filename__);
+			return;
+		}
+
+		char id[4];
+		__file.read(id, 4);
+		read_le<std::uint32_t>();
+		char wave[4];
+		__file.read(wave, 4);
+		if (std::memcmp(id, "RIFF", 4) != 0 || std::memcmp(wave, "WAVE", 4) != 0)
+			throw std::runtime_error{"Not a wav file: "s + filename__};
+
+		bool has_format = false;
+		while (__file.read(id, 4))
+		{
+			const std::uint32_t size = read_le<std::uint32_t>();
+			if (std::memcmp(id, "fmt ", 4) == 0)
+			{
+				const auto audio_format = read_le<std::uint16_t>();
+				__format.channels = read_le<std::uint16_t>();
+				__format.sample_rate = read_le<std::uint32_t>();
+				read_le<std::uint32_t>();	// byte rate
+				read_le<std::uint16_t>();	// block align
+				const auto bits = read_le<std::uint16_t>();
+				if (audio_format != 1 || bits != 16)
+					throw std::runtime_error{"Only 16 bit pcm wav is supported."};
+				__file.seekg(size - 16 + (size & 1), std::ios::cur);
+				has_format = true;
+			}
+			else if (std::memcmp(id, "data", 4) == 0)
+			{
+				if (! has_format)
+					throw std::runtime_error{"wav data before fmt."};
+				__remaining = size;
+				return;
+			}
+			else
+			{
+				__file.seekg(size + (size & 1), std::ios::cur);
+			}
+		}
+		throw std::runtime_error{"No data in wav file: "s + filename__};
+	}
+public:
+	const gpu::audio_format & format() const
+	{
+		return __format;
+	}
+	// Read up to samples__.size() / channels frames, returns the frames read.
+	std::size_t read(std::vector<std::int16_t> & samples__)
+	{
+		const std::size_t frame_bytes = __format.channels * sizeof(std::int16_t);
+		const std::size_t frames = std::min<std::uint64_t>(samples__.size() / __format.channels, __remaining / frame_bytes);
+		__file.read(reinterpret_cast<char *>(samples__.data()), frames * frame_bytes);
+		const std::size_t got = __file.gcount() / frame_bytes;
+		__remaining -= got * frame_bytes;
+		return got;
+	}
+};
+
+// 16 bit pcm wav, written in chunks. The sizes are patched on close().
+class wav_writer
+{
+private:
+	std::ofstream __file;
+	std::uint32_t __data_bytes = 0;
+private:
+	template <typename type>
+	void write_le(type value__)
+	{
+		for (std::size_t i=0; i<sizeof(type); ++i)
+			__file.put(static_cast<char>(static_cast<std::uint64_t>(value__) >> (8 * i) & 0xff));
+	}
+public:
+	wav_writer(const std::string & filename__, const gpu::audio_format & format__):
+		__file{filename__, std::ios::binary}
+	{
+		if (! __file)
+			throw std::runtime_error{"Can not write audio file: "s + filename__};
+		__file.write("RIFF", 4);
+		write_le<std::uint32_t>(0);
+		__file.write("WAVEfmt ", 8);
+		write_le<std::uint32_t>(16);
+		write_le<std::uint16_t>(1);
+		write_le<std::uint16_t>(format__.channels);
+		write_le<std::uint32_t>(format__.sample_rate);
+		write_le<std::uint32_t>(format__.sample_rate * format__.channels * 2);
+		write_le<std::uint16_t>(format__.channels * 2);
+		write_le<std::uint16_t>(16);
+		__file.write("data", 4);
+		write_le<std::uint32_t>(0);
+	}
+	~wav_writer()
+	{
+		this->close();
+	}
+public:
+	// little endian hosts only, as the samples are written as is
+	void write(const std::int16_t * samples__, std::size_t count__)
+	{
+		__file.write(reinterpret_cast<const char *>(samples__), count__ * sizeof(std::int16_t));
+		__data_bytes += count__ * sizeof(std::int16_t);
+	}
+	void close()
+	{
+		if (! __file.is_open())
+			return;
+		__file.seekp(4);
+		write_le<std::uint32_t>(36 + __data_bytes);
+		__file.seekp(40);
+		write_le<std::uint32_t>(__data_bytes);
+		__file.close();
+	}
+};
+
+// windowed sinc low pass
+std::vector<float> low_pass(double cutoff__, double sample_rate__)
+{
+	std::vector<float> out(gpu::taps);
+	const double fc = cutoff__ / sample_rate__;
+	const double middle = (gpu::taps - 1) / 2.0;
+	double sum = 0;
+	for (unsigned int i=0; i<gpu::taps; ++i)
+	{
+		const double x = i - middle;
+		const double sinc = x == 0 ? 2 * fc : std::sin(2 * std::numbers::pi * fc * x) / (std::numbers::pi * x);
+		const double window = 0.54 - 0.46 * std::cos(2 * std::numbers::pi * i / (gpu::taps - 1));
+		out[i] = static_cast<float>(sinc * window);
+		sum += out[i];
+	}
+	for (auto & h: out)
+		h /= sum;
+	return out;
+}
+
+// output[c][n] = sum_k taps[k] * input[c][n + history - k]
+class fir_kernel
+{
+private:
+	const float * __input;		// channels x (history + chunk_frames)
+	float * __output;		// channels x chunk_frames
+	const float * __taps;
+	sycl::local_accessor<float, 1> __lm_taps;
+	sycl::local_accessor<float, 1> __lm_input;
+public:
+	fir_kernel(const float * input__, float * output__, const float * taps__, sycl::handler & handler__):
+		__input{input__},
+		__output{output__},
+		__taps{taps__},
+		__lm_taps{sycl::range<1>{gpu::taps}, handler__},
+		__lm_input{sycl::range<1>{gpu::block_size + gpu::history}, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		const auto channel = item.get_global_id(0);
+		const auto lid = item.get_local_id(1);
+		const auto n0 = item.get_group(1) * gpu::block_size;
+		const float * input = __input + channel * (gpu::history + gpu::chunk_frames) + n0;
+
+		for (auto i=lid; i<gpu::taps; i+=gpu::block_size)
+			__lm_taps[i] = __taps[i];
+		for (auto i=lid; i<gpu::block_size+gpu::history; i+=gpu::block_size)
+			__lm_input[i] = input[i];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		float sum = 0;
+		for (unsigned int k=0; k<gpu::taps; ++k)
+			sum += __lm_taps[k] * __lm_input[lid + gpu::history - k];
+		__output[channel * gpu::chunk_frames + n0 + lid] = sum;
+	}
+};
+
+// One radix 2 or 4 stockham stage over each channel row, ns__ is the size of the sub-transforms done so far.
+template <unsigned int radix__>
+class fft_stage_kernel
+{
+	static_assert(radix__ == 2 || radix__ == 4);
+private:
+	const gpu::complex_type * __input;
+	gpu::complex_type * __output;
+	unsigned int __ns;
+public:
+	fft_stage_kernel(const gpu::complex_type * input__, gpu::complex_type * output__, unsigned int ns__):
+		__input{input__}, __output{output__}, __ns{ns__}
+	{
+	}
+public:
+	void operator()(sycl::item<2> item) const
+	{
+		constexpr unsigned int n = gpu::chunk_frames;
+		const auto row = item.get_id(0) * n;
+		const unsigned int j = item.get_id(1);
+
+		const float angle = -2 * std::numbers::pi_v<float> * (j % __ns) / (__ns * radix__);
+		gpu::complex_type v[radix__];
+		for (unsigned int r=0; r<radix__; ++r)
+		{
+			const gpu::complex_type x = __input[row + j + r * n / radix__];
+			const float c = sycl::cos(angle * r), s = sycl::sin(angle * r);
+			v[r] = {x.re * c - x.im * s, x.re * s + x.im * c};
+		}
+
+		if constexpr (radix__ == 2)
+		{
+			const gpu::complex_type v0 = v[0];
+			v[0] = {v0.re + v[1].re, v0.im + v[1].im};
+			v[1] = {v0.re - v[1].re, v0.im - v[1].im};
+		}
+		else
+		{
+			const gpu::complex_type a0{v[0].re + v[2].re, v[0].im + v[2].im};
+			const gpu::complex_type a1{v[0].re - v[2].re, v[0].im - v[2].im};
+			const gpu::complex_type a2{v[1].re + v[3].re, v[1].im + v[3].im};
+			// (v1 - v3) * -i
+			const gpu::complex_type a3{v[1].im - v[3].im, v[3].re - v[1].re};
+			v[0] = {a0.re + a2.re, a0.im + a2.im};
+			v[1] = {a1.re + a3.re, a1.im + a3.im};
+			v[2] = {a0.re - a2.re, a0.im - a2.im};
+			v[3] = {a1.re - a3.re, a1.im - a3.im};
+		}
+
+		const unsigned int out = (j / __ns) * __ns * radix__ + j % __ns;
+		for (unsigned int r=0; r<radix__; ++r)
+			__output[row + out + r * __ns] = v[r];
+	}
+};
+
+// fft of each row of a__ (channels__ rows of chunk_frames), on an in-order queue. Returns the result, a__ or b__.
+gpu::complex_type * fft(sycl::queue & queue__, gpu::complex_type * a__, gpu::complex_type * b__, unsigned int channels__)
+{
+	unsigned int ns = 1;
+	for (; ns*4<=gpu::chunk_frames; ns*=4)
+	{
+		queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(sycl::range<2>{channels__, gpu::chunk_frames / 4}, gpu::fft_stage_kernel<4>{a__, b__, ns});
+			}
+		);
+		std::swap(a__, b__);
+	}
+	if (ns < gpu::chunk_frames)
+	{
+		queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(sycl::range<2>{channels__, gpu::chunk_frames / 2}, gpu::fft_stage_kernel<2>{a__, b__, ns});
+			}
+		);
+		std::swap(a__, b__);
+	}
+	return a__;
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	if (argc != 3 && argc != 4)
+		throw std::runtime_error{""s + argv[0] + " <input.wav | input.raw> <output.wav> [cutoff Hz]"};
+	if (! std::filesystem::exists(argv[1]))
+		throw std::runtime_error{"Input audio does not exist: "s + argv[1]};
+	const double cutoff = argc == 4 ? std::stod(argv[3]) : 2000;
+
+	gpu::pcm_reader reader{argv[1]};
+	const auto format = reader.format();
+	const unsigned int channels = format.channels;
+	std::cout << "Input: " << channels << " channels, " << format.sample_rate << " Hz" << std::endl;
+
+	gpu::wav_writer writer{argv[2], format};
+
+	sycl::queue queue{sycl::cpu_selector_v, sycl::property_list{sycl::property::queue::in_order{}}};
+
+	constexpr auto stride = gpu::history + gpu::chunk_frames;
+	constexpr auto bins = gpu::chunk_frames / 2;
+
+	// all device memory, allocated once
+	auto * pcm = sycl::malloc_device<std::int16_t>(channels * gpu::chunk_frames, queue);
+	auto * input = sycl::malloc_device<float>(channels * stride, queue);
+	auto * output = sycl::malloc_device<float>(channels * gpu::chunk_frames, queue);
+	auto * taps = sycl::malloc_device<float>(gpu::taps, queue);
+	auto * fft_a = sycl::malloc_device<gpu::complex_type>(channels * gpu::chunk_frames, queue);
+	auto * fft_b = sycl::malloc_device<gpu::complex_type>(channels * gpu::chunk_frames, queue);
+	auto * power = sycl::malloc_device<float>(channels * bins, queue);
+	if (! pcm || ! input || ! output || ! taps || ! fft_a || ! fft_b || ! power)
+		throw std::runtime_error{"Can not allocate device memory."};
+
+	const auto host_taps = gpu::low_pass(cutoff, format.sample_rate);
+	queue.memcpy(taps, host_taps.data(), gpu::taps * sizeof(float));
+	queue.fill(input, 0.0f, channels * stride);
+	queue.fill(power, 0.0f, channels * bins);
+
+	std::vector<std::int16_t> samples(channels * gpu::chunk_frames);
+	std::uint64_t total_frames = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t frames; (frames = reader.read(samples)) > 0; )
+	{
+		total_frames += frames;
+		queue.memcpy(pcm, samples.data(), frames * channels * sizeof(std::int16_t));
+
+		// keep the last history samples, then deinterleave the new chunk after them
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::range<2>{channels, gpu::history},
+					[=] (sycl::item<2> item)
+					{
+						float * row = input + item.get_id(0) * stride;
+						row[item.get_id(1)] = row[gpu::chunk_frames + item.get_id(1)];
+					}
+				);
+			}
+		);
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::range<2>{channels, gpu::chunk_frames},
+					[=] (sycl::item<2> item)
+					{
+						const auto c = item.get_id(0), n = item.get_id(1);
+						input[c * stride + gpu::history + n] = n < frames ? pcm[n * channels + c] / 32768.0f : 0.0f;
+					}
+				);
+			}
+		);
+
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				auto kernel = gpu::fir_kernel{input, output, taps, handler};
+				handler.parallel_for(
+					sycl::nd_range<2>{
+						sycl::range<2>{channels, gpu::chunk_frames},
+						sycl::range<2>{1, gpu::block_size}
+					},
+					kernel
+				);
+			}
+		);
+
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::range<2>{frames, channels},
+					[=] (sycl::item<2> item)
+					{
+						const auto n = item.get_id(0), c = item.get_id(1);
+						const float value = sycl::clamp(output[c * gpu::chunk_frames + n] * 32768.0f, -32768.0f, 32767.0f);
+						pcm[n * channels + c] = static_cast<std::int16_t>(value);
+					}
+				);
+			}
+		);
+		auto download = queue.memcpy(samples.data(), pcm, frames * channels * sizeof(std::int16_t));
+
+		// spectrum of the filtered chunk, hann window
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::range<2>{channels, gpu::chunk_frames},
+					[=] (sycl::item<2> item)
+					{
+						const auto c = item.get_id(0), n = item.get_id(1);
+						const float window = 0.5f - 0.5f * sycl::cos(2 * std::numbers::pi_v<float> * n / gpu::chunk_frames);
+						fft_a[c * gpu::chunk_frames + n] = {output[c * gpu::chunk_frames + n] * window, 0.0f};
+					}
+				);
+			}
+		);
+		gpu::complex_type * spectrum = gpu::fft(queue, fft_a, fft_b, channels);
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::range<2>{channels, bins},
+					[=] (sycl::item<2> item)
+					{
+						const auto c = item.get_id(0), k = item.get_id(1);
+						const gpu::complex_type x = spectrum[c * gpu::chunk_frames + k];
+						power[c * bins + k] += x.re * x.re + x.im * x.im;
+					}
+				);
+			}
+		);
+
+		download.wait();
+		writer.write(samples.data(), frames * channels);
+	}
+	queue.wait();
+	writer.close();
+	auto stop = std::chrono::steady_clock::now();
+
+	const double seconds = std::chrono::duration<double>(stop - start).count();
+	const double audio_seconds = static_cast<double>(total_frames) / format.sample_rate;
+	std::cout << "Audio: " << audio_seconds << " s, processing: " << seconds << " s, realtime factor: "
+		<< std::fixed << std::setprecision(1) << audio_seconds / seconds << "x" << std::defaultfloat << std::endl;
+
+	// strongest bins of channel 0
+	std::vector<float> host_power(bins);
+	queue.memcpy(host_power.data(), power, bins * sizeof(float)).wait();
+	std::vector<unsigned int> order(bins);
+	for (unsigned int k=0; k<bins; ++k)
+		order[k] = k;
+	std::partial_sort(order.begin(), order.begin() + 5, order.end(),
+		[&] (unsigned int a__, unsigned int b__)
+		{
+			return host_power[a__] > host_power[b__];
+		}
+	);
+	std::cout << "Strongest frequencies after filtering (channel 0):" << std::endl;
+	for (int i=0; i<5; ++i)
+		std::cout << std::setw(12) << order[i] * static_cast<double>(format.sample_rate) / gpu::chunk_frames << " Hz" << std::endl;
+
+	for (void * p: {static_cast<void *>(pcm), static_cast<void *>(input), static_cast<void *>(output), static_cast<void *>(taps),
+		static_cast<void *>(fft_a), static_cast<void *>(fft_b), static_cast<void *>(power)})
+		sycl::free(p, queue);
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
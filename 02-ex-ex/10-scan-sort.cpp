@@ -0,0 +1,609 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <execution>
+#include <utility>
+#include <concepts>
+#include <climits>
+
+using std::string_literals::operator""s;
+
+// Scan, compaction, radix sort
+/*
+	Device primitives on usm data, for an in-order queue:
+
+	gpu::scan<value_type, op_type>:
+		exclusive and inclusive scan, multi-pass:
+		1. block_scan_kernel: every work-group scans a tile of
+		   local_size * items_per_work_item values. The tile is loaded into
+		   a local_accessor, each work-item scans its own values, and
+		   sycl::exclusive_scan_over_group gives the offset of each
+		   work-item. The total of every tile goes to a block sums array.
+		2. the block sums are scanned the same way (recursively)
+		3. add_offsets_kernel adds the scanned block sums to the tiles
+
+	gpu::compactor<value_type>:
+		flags = predicate(input), positions = exclusive scan of the flags,
+		then every kept value is written to output[positions[i]].
+
+	gpu::radix_sort<key_type, value_type>:
+		least significant digit first, 4 bits per pass, stable:
+		1. histogram_kernel counts the digits of every work-group with
+		   local memory atomics, digit major: histogram[digit][group]
+		2. exclusive scan of the histogram: where the keys of (digit, group)
+		   start in the output
+		3. scatter_kernel ranks the keys inside the work-group with one
+		   exclusive_scan_over_group per digit and writes keys and values
+
+	The results are checked against, and timed with, std::inclusive_scan,
+	std::copy_if and std::sort with std::execution::par.
+*/
+
+// ./prog [gpu|cpu] [size]
+
+namespace gpu
+{
+
+constexpr std::size_t local_size = 256;
+constexpr std::size_t items_per_work_item = 4;
+constexpr std::size_t tile_size = local_size * items_per_work_item;
+constexpr unsigned int radix_bits = 4;
+constexpr unsigned int radix = 1u << radix_bits;
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t groups(std::size_t size__, std::size_t per_group__)
+{
+	return (size__ + per_group__ - 1) / per_group__;
+}
+
+// output = scan of one tile per work-group, block_sums[group] = total of the tile
+template <typename value_type, typename op_type, bool inclusive>
+class block_scan_kernel
+{
+private:
+	const value_type * __input;
+	value_type * __output;
+	value_type * __block_sums;	// nullptr: only one tile
+	std::size_t __size;
+	sycl::local_accessor<value_type, 1> __lm;
+public:
+	block_scan_kernel(const value_type * input__, value_type * output__, value_type * block_sums__, std::size_t size__, sycl::handler & handler__):
+		__input{input__},
+		__output{output__},
+		__block_sums{block_sums__},
+		__size{size__},
+		__lm{sycl::range<1>{gpu::tile_size}, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<1> item) const
+	{
+		constexpr value_type identity = sycl::known_identity_v<op_type, value_type>;
+		const op_type op{};
+		const std::size_t lid = item.get_local_id(0);
+		const std::size_t group = item.get_group(0);
+		const std::size_t base = group * gpu::tile_size;
+
+		// coalesced load
+		for (std::size_t i=0; i<gpu::items_per_work_item; ++i)
+		{
+			const std::size_t index = base + i * gpu::local_size + lid;
+			__lm[i * gpu::local_size + lid] = index < __size ? __input[index] : identity;
+		}
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		// own consecutive values
+		value_type values[gpu::items_per_work_item];
+		value_type total = identity;
+		for (std::size_t k=0; k<gpu::items_per_work_item; ++k)
+		{
+			values[k] = __lm[lid * gpu::items_per_work_item + k];
+			total = op(total, values[k]);
+		}
+		value_type running = sycl::exclusive_scan_over_group(item.get_group(), total, op);
+		for (std::size_t k=0; k<gpu::items_per_work_item; ++k)
+		{
+			if constexpr (inclusive)
+			{
+				running = op(running, values[k]);
+				__lm[lid * gpu::items_per_work_item + k] = running;
+			}
+			else
+			{
+				__lm[lid * gpu::items_per_work_item + k] = running;
+				running = op(running, values[k]);
+			}
+		}
+		if (__block_sums != nullptr && lid == gpu::local_size - 1)
+			__block_sums[group] = running;
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		// coalesced store
+		for (std::size_t i=0; i<gpu::items_per_work_item; ++i)
+		{
+			const std::size_t index = base + i * gpu::local_size + lid;
+			if (index < __size)
+				__output[index] = __lm[i * gpu::local_size + lid];
+		}
+	}
+};
+
+// data[tile] = offsets[tile] op data[tile]
+template <typename value_type, typename op_type>
+class add_offsets_kernel
+{
+private:
+	value_type * __data;
+	const value_type * __offsets;
+	std::size_t __size;
+public:
+	add_offsets_kernel(value_type * data__, const value_type * offsets__, std::size_t size__):
+		__data{data__},
+		__offsets{offsets__},
+		__size{size__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<1> item) const
+	{
+		const op_type op{};
+		const std::size_t group = item.get_group(0);
+		const value_type offset = __offsets[group];
+		for (std::size_t i=0; i<gpu::items_per_work_item; ++i)
+		{
+			const std::size_t index = group * gpu::tile_size + i * gpu::local_size + item.get_local_id(0);
+			if (index < __size)
+				__data[index] = op(offset, __data[index]);
+		}
+	}
+};
+
+// Scans of up to max_size values. Owns the block sums of every level.
+template <typename value_type, typename op_type = sycl::plus<value_type>>
+class scan
+{
+private:
+	sycl::queue & __queue;
+	std::vector<value_type *> __block_sums;	// one array per level
+public:
+	scan(const scan &) = delete;
+	scan & operator=(const scan &) = delete;
+	scan(sycl::queue & queue__, std::size_t max_size__):
+		__queue{queue__}
+	{
+		if (! __queue.is_in_order())
+			throw std::invalid_argument{"gpu::scan: the queue must be in order."};
+		for (std::size_t size = gpu::groups(max_size__, gpu::tile_size); size > 1; size = gpu::groups(size, gpu::tile_size))
+		{
+			__block_sums.push_back(sycl::malloc_device<value_type>(size, __queue));
+			if (__block_sums.back() == nullptr)
+				throw std::runtime_error{"gpu::scan: can not allocate device memory."};
+		}
+	}
+	~scan()
+	{
+		__queue.wait();
+		for (auto * block_sums: __block_sums)
+			sycl::free(block_sums, __queue);
+	}
+public:
+	// input__ and output__ may be the same array
+	void exclusive(const value_type * input__, value_type * output__, std::size_t size__)
+	{
+		this->run<false>(input__, output__, size__, 0);
+	}
+	void inclusive(const value_type * input__, value_type * output__, std::size_t size__)
+	{
+		this->run<true>(input__, output__, size__, 0);
+	}
+private:
+	template <bool inclusive>
+	void run(const value_type * input__, value_type * output__, std::size_t size__, std::size_t level__)
+	{
+		if (size__ == 0)
+			return;
+		const std::size_t groups = gpu::groups(size__, gpu::tile_size);
+		if (groups > 1 && level__ >= __block_sums.size())
+			throw std::invalid_argument{"gpu::scan: size is larger than max_size."};
+		value_type * block_sums = groups > 1 ? __block_sums[level__] : nullptr;
+		const sycl::nd_range<1> range{sycl::range<1>{groups * gpu::local_size}, sycl::range<1>{gpu::local_size}};
+
+		__queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					range,
+					gpu::block_scan_kernel<value_type, op_type, inclusive>{input__, output__, block_sums, size__, handler}
+				);
+			}
+		);
+		if (groups <= 1)
+			return;
+
+		this->run<false>(block_sums, block_sums, groups, level__ + 1);
+		__queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(range, gpu::add_offsets_kernel<value_type, op_type>{output__, block_sums, size__});
+			}
+		);
+	}
+};
+
+template <typename value_type>
+class compactor
+{
+private:
+	sycl::queue & __queue;
+	gpu::scan<unsigned int> __scan;
+	unsigned int * __flags;
+	unsigned int * __positions;
+public:
+	compactor(const compactor &) = delete;
+	compactor & operator=(const compactor &) = delete;
+	compactor(sycl::queue & queue__, std::size_t max_size__):
+		__queue{queue__},
+		__scan{queue__, max_size__},
+		__flags{sycl::malloc_device<unsigned int>(std::max<std::size_t>(max_size__, 1), queue__)},
+		__positions{sycl::malloc_device<unsigned int>(std::max<std::size_t>(max_size__, 1), queue__)}
+	{
+		if (__flags == nullptr || __positions == nullptr)
+			throw std::runtime_error{"gpu::compactor: can not allocate device memory."};
+	}
+	~compactor()
+	{
+		__queue.wait();
+		sycl::free(__flags, __queue);
+		sycl::free(__positions, __queue);
+	}
+public:
+	// Writes the values with predicate__(value) == true to output__, in order,
+	// and returns how many.
+	template <typename predicate_type>
+	std::size_t operator()(const value_type * input__, value_type * output__, std::size_t size__, predicate_type predicate__)
+	{
+		if (size__ == 0)
+			return 0;
+		unsigned int * flags = __flags;
+		unsigned int * positions = __positions;
+		__queue.parallel_for(
+			sycl::range<1>{size__},
+			[=] (sycl::id<1> i)
+			{
+				flags[i] = predicate__(input__[i]) ? 1 : 0;
+			}
+		);
+		__scan.exclusive(flags, positions, size__);
+		__queue.parallel_for(
+			sycl::range<1>{size__},
+			[=] (sycl::id<1> i)
+			{
+				if (flags[i])
+					output__[positions[i]] = input__[i];
+			}
+		);
+		unsigned int last_flag = 0, last_position = 0;
+		__queue.memcpy(&last_flag, flags + size__ - 1, sizeof(unsigned int));
+		__queue.memcpy(&last_position, positions + size__ - 1, sizeof(unsigned int)).wait();
+		return last_position + last_flag;
+	}
+};
+
+// histogram[digit * groups + group] = number of keys of group with digit
+template <std::unsigned_integral key_type>
+class histogram_kernel
+{
+private:
+	const key_type * __keys;
+	std::size_t __size;
+	unsigned int __shift;
+	unsigned int * __histogram;
+	sycl::local_accessor<unsigned int, 1> __counts;
+public:
+	histogram_kernel(const key_type * keys__, std::size_t size__, unsigned int shift__, unsigned int * histogram__, sycl::handler & handler__):
+		__keys{keys__},
+		__size{size__},
+		__shift{shift__},
+		__histogram{histogram__},
+		__counts{sycl::range<1>{gpu::radix}, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<1> item) const
+	{
+		const std::size_t lid = item.get_local_id(0);
+		const std::size_t gid = item.get_global_id(0);
+		if (lid < gpu::radix)
+			__counts[lid] = 0;
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		if (gid < __size)
+		{
+			const unsigned int digit = (__keys[gid] >> __shift) & (gpu::radix - 1);
+			sycl::atomic_ref<
+				unsigned int,
+				sycl::memory_order::relaxed,
+				sycl::memory_scope::work_group,
+				sycl::access::address_space::local_space
+			> count{__counts[digit]};
+			count.fetch_add(1u);
+		}
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		if (lid < gpu::radix)
+			__histogram[lid * item.get_group_range(0) + item.get_group(0)] = __counts[lid];
+	}
+};
+
+// Stable: keys of the same digit keep the order of their work-items.
+template <std::unsigned_integral key_type, typename value_type>
+class scatter_kernel
+{
+private:
+	const key_type * __keys_in;
+	const value_type * __values_in;
+	key_type * __keys_out;
+	value_type * __values_out;
+	std::size_t __size;
+	unsigned int __shift;
+	const unsigned int * __offsets;		// scanned histogram
+public:
+	scatter_kernel(
+		const key_type * keys_in__,
+		const value_type * values_in__,
+		key_type * keys_out__,
+		value_type * values_out__,
+		std::size_t size__,
+		unsigned int shift__,
+		const unsigned int * offsets__
+	):
+		__keys_in{keys_in__},
+		__values_in{values_in__},
+		__keys_out{keys_out__},
+		__values_out{values_out__},
+		__size{size__},
+		__shift{shift__},
+		__offsets{offsets__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<1> item) const
+	{
+		const std::size_t gid = item.get_global_id(0);
+		const bool valid = gid < __size;
+		const key_type key = valid ? __keys_in[gid] : key_type{};
+		const unsigned int digit = valid ? (key >> __shift) & (gpu::radix - 1) : gpu::radix;
+
+		unsigned int rank = 0;
+		for (unsigned int d=0; d<gpu::radix; ++d)
+		{
+			const unsigned int before = sycl::exclusive_scan_over_group(item.get_group(), digit == d ? 1u : 0u, sycl::plus<unsigned int>{});
+			if (digit == d)
+				rank = before;
+		}
+		if (valid)
+		{
+			const std::size_t position = __offsets[digit * item.get_group_range(0) + item.get_group(0)] + rank;
+			__keys_out[position] = key;
+			__values_out[position] = __values_in[gid];
+		}
+	}
+};
+
+template <std::unsigned_integral key_type, typename value_type>
+class radix_sort
+{
+private:
+	sycl::queue & __queue;
+	std::size_t __max_size;
+	key_type * __keys;
+	value_type * __values;
+	unsigned int * __histogram;
+	gpu::scan<unsigned int> __scan;
+public:
+	// An even number of passes: the sorted data ends in the input arrays.
+	static_assert((sizeof(key_type) * CHAR_BIT / gpu::radix_bits) % 2 == 0);
+
+	radix_sort(const radix_sort &) = delete;
+	radix_sort & operator=(const radix_sort &) = delete;
+	radix_sort(sycl::queue & queue__, std::size_t max_size__):
+		__queue{queue__},
+		__max_size{max_size__},
+		__keys{sycl::malloc_device<key_type>(std::max<std::size_t>(max_size__, 1), queue__)},
+		__values{sycl::malloc_device<value_type>(std::max<std::size_t>(max_size__, 1), queue__)},
+		__histogram{sycl::malloc_device<unsigned int>(std::max<std::size_t>(gpu::radix * gpu::groups(max_size__, gpu::local_size), 1), queue__)},
+		__scan{queue__, gpu::radix * gpu::groups(max_size__, gpu::local_size)}
+	{
+		if (__keys == nullptr || __values == nullptr || __histogram == nullptr)
+			throw std::runtime_error{"gpu::radix_sort: can not allocate device memory."};
+	}
+	~radix_sort()
+	{
+		__queue.wait();
+		sycl::free(__keys, __queue);
+		sycl::free(__values, __queue);
+		sycl::free(__histogram, __queue);
+	}
+public:
+	// Sorts keys__ and moves values__ with them.
+	void operator()(key_type * keys__, value_type * values__, std::size_t size__)
+	{
+		if (size__ > __max_size)
+			throw std::invalid_argument{"gpu::radix_sort: size is larger than max_size."};
+		if (size__ == 0)
+			return;
+		const std::size_t groups = gpu::groups(size__, gpu::local_size);
+		const sycl::nd_range<1> range{sycl::range<1>{groups * gpu::local_size}, sycl::range<1>{gpu::local_size}};
+
+		key_type * keys_in = keys__, * keys_out = __keys;
+		value_type * values_in = values__, * values_out = __values;
+		for (unsigned int shift=0; shift<sizeof(key_type)*CHAR_BIT; shift+=gpu::radix_bits)
+		{
+			__queue.submit(
+				[&] (sycl::handler & handler)
+				{
+					handler.parallel_for(range, gpu::histogram_kernel<key_type>{keys_in, size__, shift, __histogram, handler});
+				}
+			);
+			__scan.exclusive(__histogram, __histogram, gpu::radix * groups);
+			__queue.submit(
+				[&] (sycl::handler & handler)
+				{
+					handler.parallel_for(
+						range,
+						gpu::scatter_kernel<key_type, value_type>{keys_in, values_in, keys_out, values_out, size__, shift, __histogram}
+					);
+				}
+			);
+			std::swap(keys_in, keys_out);
+			std::swap(values_in, values_out);
+		}
+	}
+};
+
+template <typename function_type>
+double measure_ms(function_type && function__)
+{
+	auto start = gpu::clock_type::now();
+	function__();
+	return std::chrono::duration<double, std::milli>(gpu::clock_type::now() - start).count();
+}
+
+void report(const std::string & name__, std::size_t size__, double device_ms__, double host_ms__)
+{
+	std::cout << std::setw(24) << std::left << name__ << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(12) << device_ms__
+		<< std::setw(12) << host_ms__
+		<< std::setw(14) << size__ / device_ms__ * 1e-3
+		<< std::setw(14) << size__ / host_ms__ * 1e-3 << std::endl;
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu] [size]"};
+	const std::size_t size = argc > 2 ? std::stoul(argv[2]) : 1u << 24;
+
+	const sycl::property_list properties{sycl::property::queue::in_order{}};
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v, properties} :
+		sycl::queue{sycl::gpu_selector_v, properties};
+
+	using key_type = unsigned int;
+	std::mt19937 engine{7};
+	std::vector<key_type> keys(size);
+	for (auto & key: keys)
+		key = engine();
+	std::vector<key_type> values(size);
+	std::iota(values.begin(), values.end(), 0u);
+
+	key_type * device_keys = sycl::malloc_device<key_type>(size, queue);
+	key_type * device_values = sycl::malloc_device<key_type>(size, queue);
+	key_type * device_output = sycl::malloc_device<key_type>(size, queue);
+	if (device_keys == nullptr || device_values == nullptr || device_output == nullptr)
+		throw std::runtime_error{"can not allocate device memory."};
+	auto upload = [&]
+	{
+		queue.memcpy(device_keys, keys.data(), size * sizeof(key_type));
+		queue.memcpy(device_values, values.data(), size * sizeof(key_type)).wait();
+	};
+	upload();
+
+	std::cout << "size: " << size << "\n\n"
+		<< std::setw(24) << std::left << "" << std::right
+		<< std::setw(12) << "device ms"
+		<< std::setw(12) << "par ms"
+		<< std::setw(14) << "device M/s"
+		<< std::setw(14) << "par M/s" << std::endl;
+
+	std::vector<key_type> result(size), expected(size);
+	auto check = [&] (const std::string & name__, std::size_t count__)
+	{
+		if (! std::equal(result.begin(), result.begin() + count__, expected.begin()))
+			throw std::runtime_error{name__ + ": wrong result"};
+	};
+
+	// scan
+	{
+		gpu::scan<key_type> scan{queue, size};
+		scan.inclusive(device_keys, device_output, size);	// warm up
+		queue.wait();
+		const double device_ms = gpu::measure_ms([&] { scan.inclusive(device_keys, device_output, size); queue.wait(); });
+		const double host_ms = gpu::measure_ms([&] { std::inclusive_scan(std::execution::par, keys.begin(), keys.end(), expected.begin()); });
+		queue.memcpy(result.data(), device_output, size * sizeof(key_type)).wait();
+		check("inclusive scan", size);
+		gpu::report("inclusive scan", size, device_ms, host_ms);
+
+		scan.exclusive(device_keys, device_output, size);
+		queue.memcpy(result.data(), device_output, size * sizeof(key_type)).wait();
+		std::exclusive_scan(std::execution::par, keys.begin(), keys.end(), expected.begin(), 0u);
+		check("exclusive scan", size);
+	}
+
+	// compaction
+	{
+		gpu::compactor<key_type> compact{queue, size};
+		auto keep = [] (key_type key__) { return key__ % 3 == 0; };
+		compact(device_keys, device_output, size, keep);	// warm up
+		std::size_t count = 0, expected_count = 0;
+		const double device_ms = gpu::measure_ms([&] { count = compact(device_keys, device_output, size, keep); });
+		const double host_ms = gpu::measure_ms([&] {
+			expected_count = std::copy_if(std::execution::par, keys.begin(), keys.end(), expected.begin(), keep) - expected.begin();
+		});
+		if (count != expected_count)
+			throw std::runtime_error{"compaction: wrong count"};
+		queue.memcpy(result.data(), device_output, count * sizeof(key_type)).wait();
+		check("compaction", count);
+		gpu::report("compaction", size, device_ms, host_ms);
+	}
+
+	// key/value radix sort
+	{
+		gpu::radix_sort<key_type, key_type> sort{queue, size};
+		sort(device_keys, device_values, size);		// warm up
+		upload();
+		const double device_ms = gpu::measure_ms([&] { sort(device_keys, device_values, size); queue.wait(); });
+
+		std::vector<std::pair<key_type, key_type>> pairs(size);
+		for (std::size_t i=0; i<size; ++i)
+			pairs[i] = {keys[i], values[i]};
+		const double host_ms = gpu::measure_ms([&] { std::sort(std::execution::par, pairs.begin(), pairs.end()); });
+
+		// stable: equal keys keep their value (the input index) order, as the sorted pairs
+		queue.memcpy(result.data(), device_keys, size * sizeof(key_type)).wait();
+		std::transform(pairs.begin(), pairs.end(), expected.begin(), [] (const auto & pair) { return pair.first; });
+		check("radix sort keys", size);
+		queue.memcpy(result.data(), device_values, size * sizeof(key_type)).wait();
+		std::transform(pairs.begin(), pairs.end(), expected.begin(), [] (const auto & pair) { return pair.second; });
+		check("radix sort values", size);
+		gpu::report("key/value radix sort", size, device_ms, host_ms);
+	}
+
+	sycl::free(device_keys, queue);
+	sycl::free(device_values, queue);
+	sycl::free(device_output, queue);
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
@@ -0,0 +1,420 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <SFML/Graphics.hpp>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+using std::string_literals::operator""s;
+
+// Piece Rotate, YUV transport
+/*
+	03-image-piece-rotate uploads 3 bytes of rgb per pixel and downloads
+	3 bytes per pixel: 6 bytes per pixel over the bus.
+
+	Here the image goes to the device as planar YUV with subsampled chroma,
+	as a jpeg decoder keeps it:
+		4:2:0: Y  W x H,  U and V  W/2 x H/2	1.5 bytes per pixel
+		4:2:2: Y  W x H,  U and V  W/2 x H	2 bytes per pixel
+
+	Every plane is rotated by its own kernel. A 256 x 256 area of the image
+	is a (256/sub_y) x (256/sub_x) area of a plane:
+		+ 4:2:0: U and V areas are 128 x 128, rotated exactly like Y
+		+ 4:2:2: U and V areas are 256 high and 128 wide; after the
+		  rotation, one chroma sample covers what were 2 chroma rows, so
+		  the kernel averages them
+
+	The rotated planes come back in the same format, ready for a jpeg
+	encoder. SFML only gives rgb pixels, so here the host converts rgb to
+	YUV (jpeg BT.601 full range) before the upload and back to rgb to save
+	the output image; the conversion is timed on its own.
+*/
+
+// ./prog <input image> <output image> [420|422] [gpu|cpu]
+// ./prog 03-q3.jpg 03-q3-output.jpg 420
+
+namespace gpu
+{
+constexpr auto area_size = 256u;
+constexpr auto block_size = 16u;
+constexpr auto lm_offset = 2u;
+
+using color_type = std::array<unsigned char, 3>;
+using clock_type = std::chrono::steady_clock;
+
+class image_type
+{
+private:
+	std::vector<gpu::color_type> __image;
+	unsigned int __width, __height;
+public:
+	image_type() = delete;
+	image_type(const std::string & filename__)
+	{
+		sf::Image * image = new sf::Image;
+		if (! image->loadFromFile(filename__))
+		{
+			delete image;
+			throw std::runtime_error{"Can not load image: "s + filename__};
+		}
+
+		{
+			auto [w, h] = image->getSize();
+			__width = w;
+			__height = h;
+		}
+
+		{
+			for (unsigned int y=0; y<__height; ++y)
+			{
+				for (unsigned int x=0; x<__width; ++x)
+				{
+					const auto & color = image->getPixel(x, y);
+					__image.push_back({color.r, color.g, color.b});
+				}
+			}
+		}
+
+		delete image;
+	}
+public:
+	std::vector<gpu::color_type> & image()
+	{
+		return __image;
+	}
+	unsigned int width() const
+	{
+		return __width;
+	}
+	unsigned int height() const
+	{
+		return __height;
+	}
+};
+
+// Subsampling of a plane: one sample covers sub_y rows and sub_x columns of pixels.
+class plane_info
+{
+public:
+	unsigned int sub_y, sub_x;
+};
+
+constexpr gpu::plane_info luma{1, 1};
+constexpr gpu::plane_info chroma420{2, 2};
+constexpr gpu::plane_info chroma422{1, 2};
+
+class yuv_image
+{
+public:
+	unsigned int width, height;
+	gpu::plane_info chroma;
+	std::vector<unsigned char> y, u, v;
+public:
+	yuv_image(unsigned int width__, unsigned int height__, gpu::plane_info chroma__):
+		width{width__},
+		height{height__},
+		chroma{chroma__},
+		y(std::size_t{width__} * height__),
+		u(std::size_t{width__ / chroma__.sub_x} * (height__ / chroma__.sub_y)),
+		v(u.size())
+	{
+	}
+public:
+	std::size_t bytes() const
+	{
+		return y.size() + u.size() + v.size();
+	}
+};
+
+inline unsigned char clamp_byte(float value__)
+{
+	return static_cast<unsigned char>(std::clamp(std::lround(value__), 0l, 255l));
+}
+
+// jpeg (BT.601 full range), chroma is the mean of the pixels of a sample
+gpu::yuv_image rgb_to_yuv(const std::vector<gpu::color_type> & rgb__, unsigned int width__, unsigned int height__, gpu::plane_info chroma__)
+{
+	gpu::yuv_image yuv{width__, height__, chroma__};
+	std::vector<float> cb(rgb__.size()), cr(rgb__.size());
+	for (std::size_t i=0; i<rgb__.size(); ++i)
+	{
+		const float r = rgb__[i][0], g = rgb__[i][1], b = rgb__[i][2];
+		yuv.y[i] = gpu::clamp_byte(0.299f * r + 0.587f * g + 0.114f * b);
+		cb[i] = -0.168736f * r - 0.331264f * g + 0.5f * b + 128;
+		cr[i] = 0.5f * r - 0.418688f * g - 0.081312f * b + 128;
+	}
+	const unsigned int chroma_width = width__ / chroma__.sub_x;
+	const float count = chroma__.sub_x * chroma__.sub_y;
+	for (unsigned int cy=0; cy<height__/chroma__.sub_y; ++cy)
+	{
+		for (unsigned int cx=0; cx<chroma_width; ++cx)
+		{
+			float sum_u = 0, sum_v = 0;
+			for (unsigned int dy=0; dy<chroma__.sub_y; ++dy)
+			{
+				for (unsigned int dx=0; dx<chroma__.sub_x; ++dx)
+				{
+					const std::size_t i = std::size_t{cy * chroma__.sub_y + dy} * width__ + cx * chroma__.sub_x + dx;
+					sum_u += cb[i];
+					sum_v += cr[i];
+				}
+			}
+			yuv.u[std::size_t{cy} * chroma_width + cx] = gpu::clamp_byte(sum_u / count);
+			yuv.v[std::size_t{cy} * chroma_width + cx] = gpu::clamp_byte(sum_v / count);
+		}
+	}
+	return yuv;
+}
+
+std::vector<gpu::color_type> yuv_to_rgb(const gpu::yuv_image & yuv__)
+{
+	std::vector<gpu::color_type> rgb(yuv__.y.size());
+	const unsigned int chroma_width = yuv__.width / yuv__.chroma.sub_x;
+	for (unsigned int y=0; y<yuv__.height; ++y)
+	{
+		for (unsigned int x=0; x<yuv__.width; ++x)
+		{
+			const std::size_t c = std::size_t{y / yuv__.chroma.sub_y} * chroma_width + x / yuv__.chroma.sub_x;
+			const float l = yuv__.y[std::size_t{y} * yuv__.width + x];
+			const float cb = yuv__.u[c] - 128.0f, cr = yuv__.v[c] - 128.0f;
+			rgb[std::size_t{y} * yuv__.width + x] = {
+				gpu::clamp_byte(l + 1.402f * cr),
+				gpu::clamp_byte(l - 0.344136f * cb - 0.714136f * cr),
+				gpu::clamp_byte(l + 1.772f * cb)
+			};
+		}
+	}
+	return rgb;
+}
+
+// 02-ex-ex/03-image-piece-rotate
+class image_piece_rotate_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	sycl::local_accessor<gpu::color_type, 3> __lm;
+public:
+	image_piece_rotate_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto y_start = static_cast<unsigned int>(gidy/gpu::area_size) * gpu::area_size;
+		auto x_start = static_cast<unsigned int>(gidx/gpu::area_size) * gpu::area_size;
+
+		auto src_gidy = gidx - x_start + y_start;
+		auto src_gidx = gidy - y_start + x_start;
+
+		color_type & lm0 = __lm[lidy][lidx][0];
+
+		lm0 = __input[src_gidy][src_gidx];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		__output[gidy][gidx] = lm0;
+	}
+};
+
+// Piece rotate of one plane. The work-item of sample (py, px) works in pixel
+// coordinates, so the areas are area_size pixels whatever the subsampling.
+class plane_piece_rotate_kernel
+{
+private:
+	sycl::accessor<unsigned char, 2, sycl::access_mode::read> __input;
+	sycl::accessor<unsigned char, 2, sycl::access_mode::write> __output;
+	gpu::plane_info __plane;
+public:
+	plane_piece_rotate_kernel(
+		sycl::buffer<unsigned char, 2> & in_buffer__,
+		sycl::buffer<unsigned char, 2> & out_buffer__,
+		gpu::plane_info plane__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__plane{plane__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		// first pixel of the sample
+		const unsigned int y = item.get_global_id(0) * __plane.sub_y;
+		const unsigned int x = item.get_global_id(1) * __plane.sub_x;
+
+		const unsigned int y_start = y / gpu::area_size * gpu::area_size;
+		const unsigned int x_start = x / gpu::area_size * gpu::area_size;
+
+		// first source pixel, and the source samples it needs: the rotated
+		// sample is sub_x pixels high and sub_y pixels wide in the source
+		const unsigned int src_py = (x - x_start + y_start) / __plane.sub_y;
+		const unsigned int src_px = (y - y_start + x_start) / __plane.sub_x;
+		const unsigned int rows = __plane.sub_x > __plane.sub_y ? __plane.sub_x / __plane.sub_y : 1;
+		const unsigned int cols = __plane.sub_y > __plane.sub_x ? __plane.sub_y / __plane.sub_x : 1;
+
+		unsigned int sum = 0;
+		for (unsigned int r=0; r<rows; ++r)
+			for (unsigned int c=0; c<cols; ++c)
+				sum += __input[src_py + r][src_px + c];
+		__output[item.get_global_id(0)][item.get_global_id(1)] = static_cast<unsigned char>((sum + rows * cols / 2) / (rows * cols));
+	}
+};
+
+void rotate_plane(sycl::queue & queue__, std::vector<unsigned char> & in__, std::vector<unsigned char> & out__, unsigned int width__, unsigned int height__, gpu::plane_info plane__)
+{
+	const sycl::range<2> range{height__ / plane__.sub_y, width__ / plane__.sub_x};
+	auto in_buffer = sycl::buffer<unsigned char, 2>{in__.data(), range};
+	auto out_buffer = sycl::buffer<unsigned char, 2>{out__.data(), range};
+	queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			handler.parallel_for(
+				sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+				gpu::plane_piece_rotate_kernel{in_buffer, out_buffer, plane__, handler}
+			);
+		}
+	);
+}
+
+// All three planes, each plane buffer is written back when it goes out of scope.
+void rotate_yuv(sycl::queue & queue__, gpu::yuv_image & in__, gpu::yuv_image & out__)
+{
+	gpu::rotate_plane(queue__, in__.y, out__.y, in__.width, in__.height, gpu::luma);
+	gpu::rotate_plane(queue__, in__.u, out__.u, in__.width, in__.height, in__.chroma);
+	gpu::rotate_plane(queue__, in__.v, out__.v, in__.width, in__.height, in__.chroma);
+}
+
+void rotate_rgb(sycl::queue & queue__, std::vector<gpu::color_type> & in__, std::vector<gpu::color_type> & out__, unsigned int width__, unsigned int height__)
+{
+	const sycl::range<2> range{height__, width__};
+	auto in_buffer = sycl::buffer<gpu::color_type, 2>{in__.data(), range};
+	auto out_buffer = sycl::buffer<gpu::color_type, 2>{out__.data(), range};
+	queue__.submit(
+		[&] (sycl::handler & handler)
+		{
+			handler.parallel_for(
+				sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+				gpu::image_piece_rotate_kernel{in_buffer, out_buffer, sycl::range<3>{gpu::block_size, gpu::block_size, gpu::lm_offset}, handler}
+			);
+		}
+	);
+}
+
+// mean milliseconds of 10 calls, after one warm up call
+template <typename function_type>
+double measure_ms(function_type && function__)
+{
+	function__();
+	auto start = gpu::clock_type::now();
+	for (int i=0; i<10; ++i)
+		function__();
+	return std::chrono::duration<double, std::milli>(gpu::clock_type::now() - start).count() / 10;
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	if (argc < 3 || argc > 5)
+		throw std::runtime_error{""s + argv[0] + " <input image> <output image> [420|422] [gpu|cpu]"};
+	if (! std::filesystem::exists(argv[1]))
+		throw std::runtime_error{"Input image does not exist: "s + argv[1]};
+	const std::string format = argc > 3 ? argv[3] : "420";
+	if (format != "420" && format != "422")
+		throw std::runtime_error{"format must be 420 or 422: "s + format};
+	const gpu::plane_info chroma = format == "420" ? gpu::chroma420 : gpu::chroma422;
+	const std::string device_name = argc > 4 ? argv[4] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " <input image> <output image> [420|422] [gpu|cpu]"};
+
+	gpu::image_type input_image{argv[1]};
+	const unsigned int width = input_image.width(), height = input_image.height();
+	std::cout << "Input image size: " << width << " x " << height << std::endl;
+
+	if (width % gpu::area_size != 0 || height % gpu::area_size != 0)
+		throw std::runtime_error{"Input image size must be N * "s + std::to_string(gpu::area_size) + " , (N > 0, N is int)"};
+
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v} :
+		sycl::queue{sycl::gpu_selector_v};
+
+	// rgb, as 03-image-piece-rotate
+	std::vector<gpu::color_type> rgb_output(input_image.image().size());
+	const double rgb_ms = gpu::measure_ms([&] { gpu::rotate_rgb(queue, input_image.image(), rgb_output, width, height); });
+
+	// yuv
+	auto start = gpu::clock_type::now();
+	gpu::yuv_image yuv_input = gpu::rgb_to_yuv(input_image.image(), width, height, chroma);
+	const double to_yuv_ms = std::chrono::duration<double, std::milli>(gpu::clock_type::now() - start).count();
+	gpu::yuv_image yuv_output{width, height, chroma};
+	const double yuv_ms = gpu::measure_ms([&] { gpu::rotate_yuv(queue, yuv_input, yuv_output); });
+	start = gpu::clock_type::now();
+	const auto output = gpu::yuv_to_rgb(yuv_output);
+	const double to_rgb_ms = std::chrono::duration<double, std::milli>(gpu::clock_type::now() - start).count();
+
+	// difference to the rgb result: the chroma subsampling loss
+	double squared_error = 0;
+	for (std::size_t i=0; i<output.size(); ++i)
+		for (int c=0; c<3; ++c)
+			squared_error += std::pow(output[i][c] - rgb_output[i][c], 2.0);
+	const double psnr = 10 * std::log10(255.0 * 255.0 / std::max(squared_error / (3.0 * output.size()), 1e-10));
+
+	const double rgb_bytes = 2.0 * 3 * width * height;
+	const double yuv_bytes = 2.0 * yuv_input.bytes();
+	std::cout << std::fixed << std::setprecision(2)
+		<< std::setw(16) << "" << std::setw(14) << "bytes moved" << std::setw(12) << "B/pixel" << std::setw(12) << "ms" << "\n"
+		<< std::setw(16) << "rgb" << std::setw(14) << static_cast<std::size_t>(rgb_bytes)
+			<< std::setw(12) << rgb_bytes / (width * height) << std::setw(12) << rgb_ms << "\n"
+		<< std::setw(16) << "yuv" + format << std::setw(14) << static_cast<std::size_t>(yuv_bytes)
+			<< std::setw(12) << yuv_bytes / (width * height) << std::setw(12) << yuv_ms << "\n"
+		<< "bytes: " << yuv_bytes / rgb_bytes * 100 << "%, speedup: " << rgb_ms / yuv_ms << "x\n"
+		<< "host conversion (not needed with a yuv decoder/encoder): rgb->yuv " << to_yuv_ms
+			<< " ms, yuv->rgb " << to_rgb_ms << " ms\n"
+		<< "psnr to the rgb result: " << psnr << " dB" << std::endl;
+
+	sf::Image output_image;
+	output_image.create(width, height);
+	for (unsigned int j=0; j<height; ++j)
+	{
+		for (unsigned int i=0; i<width; ++i)
+		{
+			const gpu::color_type & color = output[std::size_t{j} * width + i];
+			output_image.setPixel(i, j, sf::Color{color[0], color[1], color[2]});
+		}
+	}
+
+	if (! output_image.saveToFile(argv[2]))
+		throw std::runtime_error{"Save output image to file "s + argv[2] + " error."};
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
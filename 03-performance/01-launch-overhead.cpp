@@ -0,0 +1,465 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <string>
+#include <numeric>
+#include <type_traits>
+
+using std::string_literals::operator""s;
+
+// Kernel launch overhead
+/*
+	The empty kernels of 01-lambda-kernel and 02-object-kernel do no work, so
+	they measure what a launch costs: submit, schedule, run, wait.
+
+	gpu::command_batch coalesces many tiny jobs of the same kernel type into
+	one parallel_for, so N jobs pay one launch instead of N launches.
+*/
+
+// ./prog [gpu|cpu]
+
+namespace gpu
+{
+
+constexpr auto iterations = 1000;
+constexpr auto chain_length = 16;
+constexpr auto tiny_size = 16u;		// range<1>{16}, as 01-lambda-kernel
+constexpr auto tiny_jobs = 1024u;
+constexpr auto sqrt_size = 1u << 20;
+
+using clock_type = std::chrono::steady_clock;
+
+// Run function__ once to warm up (the first launch pays the jit), then return
+// the mean time of one call in microseconds.
+template <typename function_type>
+double measure_us(int iterations__, function_type && function__)
+{
+	function__();
+	auto start = gpu::clock_type::now();
+	for (int i=0; i<iterations__; ++i)
+		function__();
+	auto stop = gpu::clock_type::now();
+	return std::chrono::duration<double, std::micro>(stop - start).count() / iterations__;
+}
+
+void report(const std::string & name__, double us__)
+{
+	std::cout << std::setw(40) << std::left << name__ << std::setw(12) << std::right
+		<< std::fixed << std::setprecision(3) << us__ << " us" << std::endl;
+}
+
+class empty_kernel
+{
+public:
+	void operator()(sycl::item<1> item__) const
+	{
+		sycl::id<1> id = item__.get_id();
+	}
+};
+
+// Batched kernels are called with the index inside their own job, not with a
+// sycl::item, because the work-item belongs to the whole batch.
+class tiny_sqrt_kernel
+{
+private:
+	float * __data;
+public:
+	tiny_sqrt_kernel(float * data__):
+		__data{data__}
+	{
+	}
+public:
+	void operator()(std::size_t index__) const
+	{
+		__data[index__] = sycl::sqrt(__data[index__]);
+	}
+};
+
+// command_batch
+/*
+	push() records a job (kernel object + size) on the host, flush() uploads
+	the job table and launches a single parallel_for over the sum of all job
+	sizes. Each work-item finds its job with a binary search over the job
+	offsets.
+
+	Two device job tables are used in turn, so the host fills one table while
+	the device is still running the other.
+*/
+template <typename kernel_type>
+class command_batch
+{
+	static_assert(std::is_trivially_copyable_v<kernel_type>, "Batched kernels are copied to the device with memcpy.");
+private:
+	class slot_type
+	{
+	public:
+		kernel_type * kernels = nullptr;
+		std::size_t * offsets = nullptr;
+		std::vector<kernel_type> host_kernels;
+		std::vector<std::size_t> host_offsets;
+		sycl::event done;
+	};
+private:
+	sycl::queue & __queue;
+	std::size_t __max_jobs;
+	std::vector<kernel_type> __kernels;
+	std::vector<std::size_t> __offsets;
+	std::array<slot_type, 2> __slots;
+	std::size_t __next = 0;
+public:
+	command_batch() = delete;
+	command_batch(const command_batch &) = delete;
+	command_batch & operator=(const command_batch &) = delete;
+	command_batch(sycl::queue & queue__, std::size_t max_jobs__):
+		__queue{queue__},
+		__max_jobs{max_jobs__},
+		__offsets{0}
+	{
+		if (max_jobs__ == 0)
+			throw std::runtime_error{"command_batch: max_jobs must be > 0"};
+		for (auto & slot: __slots)
+		{
+			slot.kernels = sycl::malloc_device<kernel_type>(__max_jobs, __queue);
+			slot.offsets = sycl::malloc_device<std::size_t>(__max_jobs + 1, __queue);
+			if (slot.kernels == nullptr || slot.offsets == nullptr)
+				throw std::runtime_error{"command_batch: device allocation failed"};
+		}
+	}
+	~command_batch()
+	{
+		try
+		{
+			this->flush();
+		}
+		catch (...)
+		{
+		}
+		for (auto & slot: __slots)
+		{
+			slot.done.wait();
+			sycl::free(slot.kernels, __queue);
+			sycl::free(slot.offsets, __queue);
+		}
+	}
+public:
+	// Record a job of size__ work-items. Flushes when the job table is full.
+	void push(const kernel_type & kernel__, std::size_t size__)
+	{
+		__kernels.push_back(kernel__);
+		__offsets.push_back(__offsets.back() + size__);
+		if (__kernels.size() == __max_jobs)
+			this->flush();
+	}
+	// Launch all recorded jobs as one kernel.
+	sycl::event flush()
+	{
+		if (__kernels.empty())
+			return {};
+
+		slot_type & slot = __slots[__next];
+		__next = (__next + 1) % __slots.size();
+
+		// The slot may still be read by the batch launched two flushes ago.
+		slot.done.wait();
+		slot.host_kernels.swap(__kernels);
+		slot.host_offsets.swap(__offsets);
+		__kernels.clear();
+		__offsets.assign(1, 0);
+
+		const std::size_t jobs = slot.host_kernels.size();
+		const std::size_t total = slot.host_offsets.back();
+
+		auto copy_kernels = __queue.memcpy(slot.kernels, slot.host_kernels.data(), jobs * sizeof(kernel_type));
+		auto copy_offsets = __queue.memcpy(slot.offsets, slot.host_offsets.data(), (jobs + 1) * sizeof(std::size_t));
+
+		const kernel_type * kernels = slot.kernels;
+		const std::size_t * offsets = slot.offsets;
+
+		slot.done = __queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.depends_on({copy_kernels, copy_offsets});
+				handler.parallel_for(
+					sycl::range<1>{total},
+					[=] (sycl::item<1> item)
+					{
+						const std::size_t gid = item.get_id(0);
+						// largest job with offsets[job] <= gid
+						std::size_t lo = 0, hi = jobs;
+						while (hi - lo > 1)
+						{
+							std::size_t mid = (lo + hi) / 2;
+							if (offsets[mid] <= gid)
+								lo = mid;
+							else
+								hi = mid;
+						}
+						kernels[lo](gid - offsets[lo]);
+					}
+				);
+			}
+		);
+		return slot.done;
+	}
+	std::size_t pending() const
+	{
+		return __kernels.size();
+	}
+};
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu]"};
+
+	auto make_queue = [&] (const sycl::property_list & properties__)
+	{
+		if (device_name == "cpu")
+			return sycl::queue{sycl::cpu_selector_v, properties__};
+		return sycl::queue{sycl::gpu_selector_v, properties__};
+	};
+
+	sycl::queue queue = make_queue({});
+	sycl::queue in_order_queue = make_queue({sycl::property::queue::in_order{}});
+
+	std::cout << "Device: " << queue.get_device().get_info<sycl::info::device::name>() << std::endl;
+	std::cout << std::endl;
+
+	auto submit_empty_lambda = [] (sycl::queue & queue__)
+	{
+		return queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::range<1>{gpu::tiny_size},
+					[=] (sycl::item<1> item)
+					{
+						sycl::id<1> id = item.get_id();
+					}
+				);
+			}
+		);
+	};
+
+	auto submit_empty_object = [] (sycl::queue & queue__)
+	{
+		return queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(sycl::range<1>{gpu::tiny_size}, gpu::empty_kernel{});
+			}
+		);
+	};
+
+// submit latency and round trip
+	{
+		// submit() only, the wait is outside of the timed region
+		submit_empty_lambda(queue).wait();
+		auto start = gpu::clock_type::now();
+		for (int i=0; i<gpu::iterations; ++i)
+			submit_empty_lambda(queue);
+		auto stop = gpu::clock_type::now();
+		queue.wait();
+		gpu::report(
+			"submit latency (no wait)",
+			std::chrono::duration<double, std::micro>(stop - start).count() / gpu::iterations
+		);
+	}
+
+	gpu::report(
+		"empty kernel round trip, lambda",
+		gpu::measure_us(gpu::iterations, [&] { submit_empty_lambda(queue).wait(); })
+	);
+	gpu::report(
+		"empty kernel round trip, object",
+		gpu::measure_us(gpu::iterations, [&] { submit_empty_object(queue).wait(); })
+	);
+
+// buffer vs usm
+	{
+		std::vector<float> data(gpu::sqrt_size);
+		std::iota(data.begin(), data.end(), 1.0f);
+		sycl::buffer<float, 1> buffer{data.data(), sycl::range<1>{data.size()}};
+
+		gpu::report(
+			"sqrt 1M floats, buffer + accessor",
+			gpu::measure_us(
+				gpu::iterations / 10,
+				[&]
+				{
+					queue.submit(
+						[&] (sycl::handler & handler)
+						{
+							sycl::accessor<float, 1, sycl::access_mode::read_write> values{buffer, handler, sycl::read_write};
+							handler.parallel_for(
+								sycl::range<1>{gpu::sqrt_size},
+								[=] (sycl::item<1> item)
+								{
+									values[item.get_id()] = sycl::sqrt(values[item.get_id()]);
+								}
+							);
+						}
+					).wait();
+				}
+			)
+		);
+
+		float * device_data = sycl::malloc_device<float>(gpu::sqrt_size, queue);
+		if (device_data == nullptr)
+			throw std::runtime_error{"Can not allocate device memory."};
+		queue.memcpy(device_data, data.data(), gpu::sqrt_size * sizeof(float)).wait();
+
+		gpu::report(
+			"sqrt 1M floats, usm device pointer",
+			gpu::measure_us(
+				gpu::iterations / 10,
+				[&]
+				{
+					queue.submit(
+						[&] (sycl::handler & handler)
+						{
+							handler.parallel_for(
+								sycl::range<1>{gpu::sqrt_size},
+								[=] (sycl::item<1> item)
+								{
+									device_data[item.get_id(0)] = sycl::sqrt(device_data[item.get_id(0)]);
+								}
+							);
+						}
+					).wait();
+				}
+			)
+		);
+
+		sycl::free(device_data, queue);
+	}
+
+// in-order vs out-of-order, queue.wait() vs event chaining
+	std::cout << std::endl << "chain of " << gpu::chain_length << " dependent empty kernels:" << std::endl;
+
+	gpu::report(
+		"in-order queue, one wait",
+		gpu::measure_us(
+			gpu::iterations / 10,
+			[&]
+			{
+				for (int i=0; i<gpu::chain_length; ++i)
+					submit_empty_lambda(in_order_queue);
+				in_order_queue.wait();
+			}
+		)
+	);
+
+	gpu::report(
+		"out-of-order queue, depends_on chain",
+		gpu::measure_us(
+			gpu::iterations / 10,
+			[&]
+			{
+				sycl::event last;
+				for (int i=0; i<gpu::chain_length; ++i)
+				{
+					last = queue.submit(
+						[&] (sycl::handler & handler)
+						{
+							handler.depends_on(last);
+							handler.parallel_for(sycl::range<1>{gpu::tiny_size}, gpu::empty_kernel{});
+						}
+					);
+				}
+				last.wait();
+			}
+		)
+	);
+
+	gpu::report(
+		"out-of-order queue, queue.wait() each",
+		gpu::measure_us(
+			gpu::iterations / 10,
+			[&]
+			{
+				for (int i=0; i<gpu::chain_length; ++i)
+				{
+					submit_empty_object(queue);
+					queue.wait();
+				}
+			}
+		)
+	);
+
+// command batching
+	std::cout << std::endl << gpu::tiny_jobs << " jobs of " << gpu::tiny_size << " items:" << std::endl;
+	{
+		float * device_data = sycl::malloc_device<float>(gpu::tiny_jobs * gpu::tiny_size, queue);
+		if (device_data == nullptr)
+			throw std::runtime_error{"Can not allocate device memory."};
+		queue.fill(device_data, 4.0f, gpu::tiny_jobs * gpu::tiny_size).wait();
+
+		gpu::report(
+			"one submit per job",
+			gpu::measure_us(
+				10,
+				[&]
+				{
+					for (unsigned int job=0; job<gpu::tiny_jobs; ++job)
+					{
+						gpu::tiny_sqrt_kernel kernel{device_data + job * gpu::tiny_size};
+						queue.submit(
+							[&] (sycl::handler & handler)
+							{
+								handler.parallel_for(
+									sycl::range<1>{gpu::tiny_size},
+									[=] (sycl::item<1> item)
+									{
+										kernel(item.get_id(0));
+									}
+								);
+							}
+						);
+					}
+					queue.wait();
+				}
+			)
+		);
+
+		for (std::size_t max_jobs: {16u, 256u, 1024u})
+		{
+			gpu::command_batch<gpu::tiny_sqrt_kernel> batch{queue, max_jobs};
+			gpu::report(
+				"command_batch, " + std::to_string(max_jobs) + " jobs per submit",
+				gpu::measure_us(
+					10,
+					[&]
+					{
+						for (unsigned int job=0; job<gpu::tiny_jobs; ++job)
+							batch.push(gpu::tiny_sqrt_kernel{device_data + job * gpu::tiny_size}, gpu::tiny_size);
+						batch.flush();
+						queue.wait();
+					}
+				)
+			);
+		}
+
+		sycl::free(device_data, queue);
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
@@ -0,0 +1,354 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <functional>
+#include <optional>
+#include <random>
+#include <cmath>
+
+using std::string_literals::operator""s;
+
+// Record once, replay many times
+/*
+	A fixed pipeline (copy in, matrix multiplication, matrix addition, copy
+	out) is run again and again with new inputs. Rebuilding the command groups
+	with queue.submit lambdas on each run costs host time.
+
+	gpu::pipeline records the command groups once on an in-order queue:
+		+ with the sycl command graph extension (SYCL_EXT_ONEAPI_GRAPH), the
+		  recording is finalized into an executable graph and replayed with
+		  queue.ext_oneapi_graph().
+		+ otherwise the pre-built command groups are kept in a list and
+		  replayed in order on the in-order queue.
+
+	New inputs are written to the same host staging memory, so the recorded
+	copies pick them up on the next replay.
+*/
+
+// ./prog [gpu|cpu]
+
+namespace gpu
+{
+
+constexpr auto dim = 64u;
+constexpr auto ldim = 8u;
+constexpr auto size = dim * dim;
+constexpr auto iterations = 200;
+
+using value_type = float;
+using clock_type = std::chrono::steady_clock;
+
+// m2 = m0 x m1, square dim x dim matrices
+class multiplication_kernel
+{
+private:
+	const value_type * __m0;
+	const value_type * __m1;
+	value_type * __m2;
+public:
+	multiplication_kernel(const value_type * m0__, const value_type * m1__, value_type * m2__):
+		__m0{m0__}, __m1{m1__}, __m2{m2__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		value_type sum = 0;
+		for (unsigned int i=0; i<gpu::dim; ++i)
+			sum += __m0[gidy*gpu::dim+i] * __m1[i*gpu::dim+gidx];
+		__m2[gidy*gpu::dim+gidx] = sum;
+	}
+};
+
+// m2 = m0 + m1
+class addition_kernel
+{
+private:
+	const value_type * __m0;
+	const value_type * __m1;
+	value_type * __m2;
+public:
+	addition_kernel(const value_type * m0__, const value_type * m1__, value_type * m2__):
+		__m0{m0__}, __m1{m1__}, __m2{m2__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto index = item.get_global_linear_id();
+		__m2[index] = __m0[index] + __m1[index];
+	}
+};
+
+class pipeline
+{
+public:
+	using command_group_type = std::function<void(sycl::handler &)>;
+private:
+	sycl::queue & __queue;
+	std::vector<command_group_type> __command_groups;
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+	std::optional<sycl::ext::oneapi::experimental::command_graph<
+		sycl::ext::oneapi::experimental::graph_state::executable
+	>> __graph;
+#endif
+public:
+	pipeline() = delete;
+	pipeline(sycl::queue & queue__):
+		__queue{queue__}
+	{
+		if (! __queue.is_in_order())
+			throw std::runtime_error{"gpu::pipeline requires an in-order queue."};
+	}
+public:
+	void add(command_group_type command_group__)
+	{
+		__command_groups.push_back(std::move(command_group__));
+	}
+	// Record the command groups into a command graph, if the extension exists.
+	void finalize()
+	{
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+		namespace exp = sycl::ext::oneapi::experimental;
+		exp::command_graph graph{__queue.get_context(), __queue.get_device()};
+		graph.begin_recording(__queue);
+		for (const auto & command_group: __command_groups)
+			__queue.submit(command_group);
+		graph.end_recording(__queue);
+		__graph.emplace(graph.finalize());
+#endif
+	}
+	sycl::event replay()
+	{
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+		if (__graph)
+			return __queue.ext_oneapi_graph(* __graph);
+#endif
+		sycl::event last;
+		for (const auto & command_group: __command_groups)
+			last = __queue.submit(command_group);
+		return last;
+	}
+	static constexpr bool uses_command_graph()
+	{
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+		return true;
+#else
+		return false;
+#endif
+	}
+};
+
+// Device memory of the pipeline, and host staging memory for its inputs and output.
+class matrices
+{
+private:
+	sycl::queue & __queue;
+public:
+	value_type * m0, * m1, * product, * result;
+	std::vector<value_type> host_m0, host_m1, host_result;
+public:
+	matrices(sycl::queue & queue__):
+		__queue{queue__},
+		m0{sycl::malloc_device<value_type>(gpu::size, queue__)},
+		m1{sycl::malloc_device<value_type>(gpu::size, queue__)},
+		product{sycl::malloc_device<value_type>(gpu::size, queue__)},
+		result{sycl::malloc_device<value_type>(gpu::size, queue__)},
+		host_m0(gpu::size),
+		host_m1(gpu::size),
+		host_result(gpu::size)
+	{
+		if (! m0 || ! m1 || ! product || ! result)
+			throw std::runtime_error{"Can not allocate device memory."};
+	}
+	~matrices()
+	{
+		__queue.wait();
+		sycl::free(m0, __queue);
+		sycl::free(m1, __queue);
+		sycl::free(product, __queue);
+		sycl::free(result, __queue);
+	}
+};
+
+// result = m0 x m1 + m0
+std::vector<value_type> reference(const std::vector<value_type> & m0__, const std::vector<value_type> & m1__)
+{
+	std::vector<value_type> out(gpu::size);
+	for (unsigned int j=0; j<gpu::dim; ++j)
+	{
+		for (unsigned int i=0; i<gpu::dim; ++i)
+		{
+			value_type sum = 0;
+			for (unsigned int k=0; k<gpu::dim; ++k)
+				sum += m0__[j*gpu::dim+k] * m1__[k*gpu::dim+i];
+			out[j*gpu::dim+i] = sum + m0__[j*gpu::dim+i];
+		}
+	}
+	return out;
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu]"};
+
+	const sycl::property_list properties{sycl::property::queue::in_order{}};
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v, properties} :
+		sycl::queue{sycl::gpu_selector_v, properties};
+
+	std::cout << "Device: " << queue.get_device().get_info<sycl::info::device::name>() << std::endl;
+	std::cout << "Command graph: " << (gpu::pipeline::uses_command_graph() ? "yes" : "no (command group list)") << std::endl;
+	std::cout << std::endl;
+
+	gpu::matrices data{queue};
+
+	const sycl::nd_range<2> range{
+		sycl::range<2>{gpu::dim, gpu::dim},
+		sycl::range<2>{gpu::ldim, gpu::ldim}
+	};
+
+	std::mt19937 engine{7};
+	std::uniform_real_distribution<gpu::value_type> distribution{-1, 1};
+	auto new_inputs = [&]
+	{
+		for (auto & x: data.host_m0)
+			x = distribution(engine);
+		for (auto & x: data.host_m1)
+			x = distribution(engine);
+	};
+
+	auto check = [&]
+	{
+		auto expected = gpu::reference(data.host_m0, data.host_m1);
+		for (unsigned int i=0; i<gpu::size; ++i)
+		{
+			if (std::abs(expected[i] - data.host_result[i]) > 1e-3f)
+				throw std::runtime_error{"Wrong result at index "s + std::to_string(i)};
+		}
+	};
+
+	auto report = [] (const std::string & name__, double host_us__, double total_us__)
+	{
+		std::cout << std::setw(32) << std::left << name__
+			<< "host " << std::setw(10) << std::right << std::fixed << std::setprecision(3) << host_us__ << " us"
+			<< "    total " << std::setw(10) << total_us__ << " us" << std::endl;
+	};
+
+// before: rebuild the command groups on every iteration
+	{
+		double host_us = 0, total_us = 0;
+		for (int iteration=0; iteration<=gpu::iterations; ++iteration)
+		{
+			new_inputs();
+			auto start = gpu::clock_type::now();
+
+			queue.memcpy(data.m0, data.host_m0.data(), gpu::size * sizeof(gpu::value_type));
+			queue.memcpy(data.m1, data.host_m1.data(), gpu::size * sizeof(gpu::value_type));
+			queue.submit(
+				[&] (sycl::handler & handler)
+				{
+					handler.parallel_for(range, gpu::multiplication_kernel{data.m0, data.m1, data.product});
+				}
+			);
+			queue.submit(
+				[&] (sycl::handler & handler)
+				{
+					handler.parallel_for(range, gpu::addition_kernel{data.product, data.m0, data.result});
+				}
+			);
+			queue.memcpy(data.host_result.data(), data.result, gpu::size * sizeof(gpu::value_type));
+
+			auto submitted = gpu::clock_type::now();
+			queue.wait();
+			auto stop = gpu::clock_type::now();
+
+			// iteration 0 is the warm up
+			if (iteration > 0)
+			{
+				host_us += std::chrono::duration<double, std::micro>(submitted - start).count();
+				total_us += std::chrono::duration<double, std::micro>(stop - start).count();
+			}
+		}
+		check();
+		report("submit per iteration", host_us / gpu::iterations, total_us / gpu::iterations);
+	}
+
+// after: record once, replay
+	{
+		gpu::pipeline pipeline{queue};
+		pipeline.add(
+			[&] (sycl::handler & handler)
+			{
+				handler.memcpy(data.m0, data.host_m0.data(), gpu::size * sizeof(gpu::value_type));
+			}
+		);
+		pipeline.add(
+			[&] (sycl::handler & handler)
+			{
+				handler.memcpy(data.m1, data.host_m1.data(), gpu::size * sizeof(gpu::value_type));
+			}
+		);
+		pipeline.add(
+			[kernel = gpu::multiplication_kernel{data.m0, data.m1, data.product}, range] (sycl::handler & handler)
+			{
+				handler.parallel_for(range, kernel);
+			}
+		);
+		pipeline.add(
+			[kernel = gpu::addition_kernel{data.product, data.m0, data.result}, range] (sycl::handler & handler)
+			{
+				handler.parallel_for(range, kernel);
+			}
+		);
+		pipeline.add(
+			[&] (sycl::handler & handler)
+			{
+				handler.memcpy(data.host_result.data(), data.result, gpu::size * sizeof(gpu::value_type));
+			}
+		);
+		pipeline.finalize();
+
+		double host_us = 0, total_us = 0;
+		for (int iteration=0; iteration<=gpu::iterations; ++iteration)
+		{
+			new_inputs();
+			auto start = gpu::clock_type::now();
+			auto done = pipeline.replay();
+			auto submitted = gpu::clock_type::now();
+			done.wait();
+			auto stop = gpu::clock_type::now();
+
+			if (iteration > 0)
+			{
+				host_us += std::chrono::duration<double, std::micro>(submitted - start).count();
+				total_us += std::chrono::duration<double, std::micro>(stop - start).count();
+			}
+		}
+		check();
+		report("recorded pipeline replay", host_us / gpu::iterations, total_us / gpu::iterations);
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "trace.hpp"
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <numeric>
+#include <string>
+
+using std::string_literals::operator""s;
+
+// Hot path instrumentation
+/*
+	The sqrt kernel of 04-host-access and the matrix addition kernel of
+	02-ex-ex/01-matrix-addition are submitted through gpu::trace::recorder,
+	and the results are read back through it too.
+
+	03-trace is built with HAPPY_TRACE, 03-trace-off is the same source
+	without it: the recorder compiles down to plain submit/host access.
+*/
+
+// ./prog [gpu|cpu] [trace.json]
+// Open trace.json in chrome://tracing or https://ui.perfetto.dev
+
+namespace gpu
+{
+
+template <std::floating_point value_type, unsigned int dimensions>
+class sqrt_kernel
+{
+private:
+	sycl::accessor<value_type, dimensions, sycl::access_mode::read> __input;
+	sycl::accessor<value_type, dimensions, sycl::access_mode::write> __output;
+public:
+	sqrt_kernel(
+		sycl::buffer<value_type, dimensions> & in_buffer__,
+		sycl::buffer<value_type, dimensions> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::item<dimensions> item) const
+	{
+		__output[item.get_id()] = sycl::sqrt(__input[item.get_id()]);
+	}
+};
+
+template <typename value_type>
+class addition_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+public:
+	addition_kernel(
+		sycl::buffer<value_type, 2> & matrix0__,
+		sycl::buffer<value_type, 2> & matrix1__,
+		sycl::buffer<value_type, 2> & matrix2__,
+		sycl::handler & handler__
+	):
+		__matrix0{matrix0__, handler__, sycl::read_only},
+		__matrix1{matrix1__, handler__, sycl::read_only},
+		__matrix2{matrix2__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		__matrix2[gidy][gidx] = __matrix0[gidy][gidx] + __matrix1[gidy][gidx];
+	}
+};
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	const std::string trace_file = argc > 2 ? argv[2] : "trace.json";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu] [trace.json]"};
+
+	const auto properties = gpu::trace::recorder::queue_properties();
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v, properties} :
+		sycl::queue{sycl::gpu_selector_v, properties};
+
+	gpu::trace::recorder recorder;
+
+	constexpr auto size = 1u << 20;
+	constexpr auto dimy = 1024u, dimx = 1024u, ldimy = 16u, ldimx = 16u;
+	using value_type = float;
+
+	std::vector<value_type> input(size);
+	std::iota(input.begin(), input.end(), 1.0f);
+	auto in_buffer = sycl::buffer<value_type, 1>{input.data(), sycl::range<1>{input.size()}};
+	auto out_buffer = sycl::buffer<value_type, 1>{sycl::range<1>{input.size()}};
+
+	for (int i=0; i<4; ++i)
+	{
+		recorder.submit(
+			queue,
+			[&] { return gpu::trace::make_info("sqrt_kernel", sycl::range<1>{size}, gpu::trace::bytes(in_buffer, out_buffer)); },
+			[&] (sycl::handler & handler)
+			{
+				gpu::sqrt_kernel<value_type, 1u> kernel{in_buffer, out_buffer, handler};
+				handler.parallel_for<class kn1>(sycl::range<1>{size}, kernel);
+			}
+		);
+	}
+
+	// each buffer owns its host memory: no aliasing, no write back over input
+	std::vector<value_type> matrix0(input), matrix1(input);
+	auto m0_buff = sycl::buffer<value_type, 2>{matrix0.data(), sycl::range<2>{dimy, dimx}};
+	auto m1_buff = sycl::buffer<value_type, 2>{matrix1.data(), sycl::range<2>{dimy, dimx}};
+	auto m2_buff = sycl::buffer<value_type, 2>{sycl::range<2>{dimy, dimx}};
+	const sycl::nd_range<2> range{sycl::range<2>{dimy, dimx}, sycl::range<2>{ldimy, ldimx}};
+
+	for (int i=0; i<4; ++i)
+	{
+		recorder.submit(
+			queue,
+			[&] { return gpu::trace::make_info("name1", range, gpu::trace::bytes(m0_buff, m1_buff, m2_buff)); },
+			[&] (sycl::handler & handler)
+			{
+				auto kernel = gpu::addition_kernel{m0_buff, m1_buff, m2_buff, handler};
+				handler.parallel_for<class name1>(range, kernel);
+			}
+		);
+	}
+
+	{
+		auto host_access = recorder.host_access(out_buffer, "out_buffer");
+		std::cout << "sqrt: " << host_access[0] << " " << host_access[1] << " " << host_access[2] << std::endl;
+	}
+	{
+		auto host_access = recorder.host_access(m2_buff, "m2_buff");
+		std::cout << "addition: " << host_access[0][0] << " " << host_access[0][1] << " " << host_access[0][2] << std::endl;
+	}
+	std::cout << std::endl;
+
+	recorder.write_summary(std::cout);
+
+	if (gpu::trace::recorder::enabled)
+	{
+		std::ofstream out{trace_file};
+		if (! out)
+			throw std::runtime_error{"Can not write trace file: "s + trace_file};
+		recorder.write_chrome_trace(out);
+		std::cout << std::endl << "Chrome trace: " << trace_file << std::endl;
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
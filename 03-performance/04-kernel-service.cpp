@@ -0,0 +1,623 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <concepts>
+#include <semaphore>
+#include <chrono>
+#include <random>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+
+using std::string_literals::operator""s;
+
+// Kernel service
+/*
+	Many host threads call the kernels of 05-work-group (sqrt) and
+	03-image-piece-rotate (piece rotate) at once.
+
+	gpu::kernel_service takes their jobs through a lock-free bounded mpmc
+	queue and returns std::future results. Dispatcher threads pop as many
+	jobs as are waiting (up to max_batch), put jobs of the same kind into one
+	buffer and run them with one kernel:
+		sqrt:		all inputs one after another, one 2d nd_range
+		piece rotate:	images of the same width stacked on top of each other
+				(heights are N * area_size, so the areas do not change)
+
+	At most max_in_flight jobs are accepted and not done yet; a caller of
+	submit blocks until there is room again (back pressure).
+
+	The load generator runs client threads in a closed loop and prints the
+	latency percentiles, for the service and for each client calling
+	queue.submit by itself.
+*/
+
+// ./prog [gpu|cpu]
+
+namespace gpu
+{
+constexpr auto area_size = 256u;
+constexpr auto block_size = 16u;
+constexpr auto lm_offset = 2u;
+
+using color_type = std::array<unsigned char, 3>;
+using clock_type = std::chrono::steady_clock;
+
+// The kernel of 01-basic-sycl/05-work-group.
+template <std::floating_point value_type>
+class kernel2d_class
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __output;
+public:
+	kernel2d_class(
+		sycl::buffer<value_type, 2> & in_buffer__,
+		sycl::buffer<value_type, 2> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item__) const
+	{
+		const auto idy = item__.get_global_id(0);
+		const auto idx = item__.get_global_id(1);
+		__output[idy][idx] = sycl::sqrt(__input[idy][idx]);
+	}
+};
+
+// The kernel of 02-ex-ex/03-image-piece-rotate.
+class image_piece_rotate_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	sycl::local_accessor<gpu::color_type, 3> __lm;
+public:
+	image_piece_rotate_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto y_start = static_cast<unsigned int>(gidy/gpu::area_size) * gpu::area_size;
+		auto x_start = static_cast<unsigned int>(gidx/gpu::area_size) * gpu::area_size;
+
+		auto src_gidy = gidx - x_start + y_start;
+		auto src_gidx = gidy - y_start + x_start;
+
+		color_type & lm0 = __lm[lidy][lidx][0];
+
+		lm0 = __input[src_gidy][src_gidx];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		__output[gidy][gidx] = lm0;
+	}
+};
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's ring).
+template <typename value_type>
+class mpmc_queue
+{
+private:
+	class cell_type
+	{
+	public:
+		std::atomic<std::size_t> sequence;
+		value_type value;
+	};
+private:
+	std::unique_ptr<cell_type[]> __cells;
+	std::size_t __mask;
+	alignas(64) std::atomic<std::size_t> __tail{0};
+	alignas(64) std::atomic<std::size_t> __head{0};
+public:
+	mpmc_queue(std::size_t capacity__)
+	{
+		std::size_t capacity = 2;
+		while (capacity < capacity__)
+			capacity *= 2;
+		__cells.reset(new cell_type[capacity]);
+		__mask = capacity - 1;
+		for (std::size_t i=0; i<capacity; ++i)
+			__cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+public:
+	bool try_push(value_type && value__)
+	{
+		std::size_t position = __tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			cell_type & cell = __cells[position & __mask];
+			const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+			if (diff == 0)
+			{
+				if (__tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					cell.value = std::move(value__);
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;	// full
+			}
+			else
+			{
+				position = __tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	bool try_pop(value_type & value__)
+	{
+		std::size_t position = __head.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			cell_type & cell = __cells[position & __mask];
+			const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+			if (diff == 0)
+			{
+				if (__head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					value__ = std::move(cell.value);
+					cell.sequence.store(position + __mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;	// empty
+			}
+			else
+			{
+				position = __head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+};
+
+class kernel_service
+{
+public:
+	using sqrt_result = std::vector<float>;
+	using image_result = std::vector<gpu::color_type>;
+private:
+	class job_type
+	{
+	public:
+		enum class kind_type { sqrt, piece_rotate } kind = kind_type::sqrt;
+		std::vector<float> values;
+		std::vector<gpu::color_type> image;
+		unsigned int width = 0, height = 0;
+		std::promise<sqrt_result> sqrt_promise;
+		std::promise<image_result> image_promise;
+	};
+private:
+	sycl::queue & __queue;
+	std::size_t __max_batch;
+	gpu::mpmc_queue<std::unique_ptr<job_type>> __jobs;
+	std::counting_semaphore<> __room;		// max_in_flight - jobs in flight
+	std::atomic<std::size_t> __waiting{0};		// jobs in __jobs
+	std::atomic<bool> __stop{false};
+	std::vector<std::thread> __dispatchers;
+	std::atomic<std::size_t> __batches{0}, __batched_jobs{0};
+public:
+	kernel_service(sycl::queue & queue__, std::size_t max_in_flight__, std::size_t max_batch__, unsigned int dispatchers__ = 2):
+		__queue{queue__},
+		__max_batch{max_batch__},
+		__jobs{max_in_flight__},
+		__room{static_cast<std::ptrdiff_t>(max_in_flight__)}
+	{
+		for (unsigned int i=0; i<dispatchers__; ++i)
+			__dispatchers.emplace_back([this] { this->dispatch(); });
+	}
+	~kernel_service()
+	{
+		__stop.store(true);
+		__waiting.fetch_add(1);
+		__waiting.notify_all();
+		for (auto & thread: __dispatchers)
+			thread.join();
+	}
+public:
+	// element-wise sqrt of any number of values
+	std::future<sqrt_result> sqrt(std::vector<float> values__)
+	{
+		auto job = std::make_unique<job_type>();
+		job->kind = job_type::kind_type::sqrt;
+		job->values = std::move(values__);
+		auto future = job->sqrt_promise.get_future();
+		this->push(std::move(job));
+		return future;
+	}
+	// width__ and height__ are N * area_size
+	std::future<image_result> piece_rotate(std::vector<gpu::color_type> image__, unsigned int width__, unsigned int height__)
+	{
+		if (width__ % gpu::area_size != 0 || height__ % gpu::area_size != 0 || image__.size() != std::size_t{width__} * height__)
+			throw std::invalid_argument{"kernel_service::piece_rotate: image size must be N * "s + std::to_string(gpu::area_size)};
+		auto job = std::make_unique<job_type>();
+		job->kind = job_type::kind_type::piece_rotate;
+		job->image = std::move(image__);
+		job->width = width__;
+		job->height = height__;
+		auto future = job->image_promise.get_future();
+		this->push(std::move(job));
+		return future;
+	}
+	double mean_batch() const
+	{
+		return __batches ? static_cast<double>(__batched_jobs) / __batches : 0;
+	}
+private:
+	void push(std::unique_ptr<job_type> && job__)
+	{
+		// back pressure: the ring has room for max_in_flight jobs
+		__room.acquire();
+		while (! __jobs.try_push(std::move(job__)))
+			std::this_thread::yield();
+		__waiting.fetch_add(1, std::memory_order_release);
+		__waiting.notify_one();
+	}
+	void dispatch()
+	{
+		std::vector<std::unique_ptr<job_type>> batch;
+		while (true)
+		{
+			__waiting.wait(0, std::memory_order_acquire);
+			if (__stop.load())
+				return;
+
+			batch.clear();
+			std::unique_ptr<job_type> job;
+			while (batch.size() < __max_batch && __jobs.try_pop(job))
+			{
+				__waiting.fetch_sub(1, std::memory_order_relaxed);
+				batch.push_back(std::move(job));
+			}
+			if (batch.empty())
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			__batches.fetch_add(1, std::memory_order_relaxed);
+			__batched_jobs.fetch_add(batch.size(), std::memory_order_relaxed);
+
+			std::vector<job_type *> sqrt_jobs;
+			std::map<unsigned int, std::vector<job_type *>> image_jobs;	// by width
+			for (auto & j: batch)
+			{
+				if (j->kind == job_type::kind_type::sqrt)
+					sqrt_jobs.push_back(j.get());
+				else
+					image_jobs[j->width].push_back(j.get());
+			}
+
+			// one failure fails its own group only
+			if (! sqrt_jobs.empty())
+			{
+				try
+				{
+					this->run_sqrt(sqrt_jobs);
+				}
+				catch (...)
+				{
+					for (auto * j: sqrt_jobs)
+						fail(j->sqrt_promise, std::current_exception());
+				}
+			}
+			for (auto & [width, jobs]: image_jobs)
+			{
+				try
+				{
+					this->run_piece_rotate(jobs, width);
+				}
+				catch (...)
+				{
+					for (auto * j: jobs)
+						fail(j->image_promise, std::current_exception());
+				}
+			}
+			__room.release(batch.size());
+		}
+	}
+	// A promise set before the failure keeps its value.
+	template <typename promise_type>
+	static void fail(promise_type & promise__, std::exception_ptr error__)
+	{
+		try
+		{
+			promise__.set_exception(error__);
+		}
+		catch (const std::future_error &)
+		{
+		}
+	}
+	void run_sqrt(const std::vector<job_type *> & jobs__)
+	{
+		constexpr std::size_t cols = gpu::block_size;
+		constexpr std::size_t tile = gpu::block_size * gpu::block_size;
+		std::size_t total = 0;
+		for (auto * j: jobs__)
+			total += j->values.size();
+		const std::size_t padded = (total + tile - 1) / tile * tile;
+
+		std::vector<float> input(padded, 0.0f), output(padded);
+		std::size_t offset = 0;
+		for (auto * j: jobs__)
+		{
+			std::copy(j->values.begin(), j->values.end(), input.begin() + offset);
+			offset += j->values.size();
+		}
+		{
+			const sycl::range<2> range{padded / cols, cols};
+			auto in_buffer = sycl::buffer<float, 2>{input.data(), range};
+			auto out_buffer = sycl::buffer<float, 2>{output.data(), range};
+			__queue.submit(
+				[&] (sycl::handler & handler)
+				{
+					gpu::kernel2d_class kernel{in_buffer, out_buffer, handler};
+					handler.parallel_for(
+						sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+						kernel
+					);
+				}
+			);
+		}
+		offset = 0;
+		for (auto * j: jobs__)
+		{
+			j->sqrt_promise.set_value({output.begin() + offset, output.begin() + offset + j->values.size()});
+			offset += j->values.size();
+		}
+	}
+	void run_piece_rotate(const std::vector<job_type *> & jobs__, unsigned int width__)
+	{
+		std::size_t height = 0;
+		for (auto * j: jobs__)
+			height += j->height;
+
+		std::vector<gpu::color_type> input(height * width__), output(height * width__);
+		std::size_t offset = 0;
+		for (auto * j: jobs__)
+		{
+			std::copy(j->image.begin(), j->image.end(), input.begin() + offset);
+			offset += j->image.size();
+		}
+		{
+			const sycl::range<2> range{height, width__};
+			auto in_buffer = sycl::buffer<gpu::color_type, 2>{input.data(), range};
+			auto out_buffer = sycl::buffer<gpu::color_type, 2>{output.data(), range};
+			__queue.submit(
+				[&] (sycl::handler & handler)
+				{
+					auto piece_rotate = gpu::image_piece_rotate_kernel{
+						in_buffer,
+						out_buffer,
+						sycl::range<3>{gpu::block_size, gpu::block_size, gpu::lm_offset},
+						handler
+					};
+					handler.parallel_for(
+						sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+						piece_rotate
+					);
+				}
+			);
+		}
+		offset = 0;
+		for (auto * j: jobs__)
+		{
+			j->image_promise.set_value({output.begin() + offset, output.begin() + offset + j->image.size()});
+			offset += j->image.size();
+		}
+	}
+};
+
+class latency_report
+{
+private:
+	std::vector<double> __us;
+public:
+	void add(const std::vector<double> & us__)
+	{
+		__us.insert(__us.end(), us__.begin(), us__.end());
+	}
+	void print(const std::string & name__, double seconds__)
+	{
+		std::sort(__us.begin(), __us.end());
+		auto percentile = [&] (double p__)
+		{
+			return __us[std::min(__us.size() - 1, static_cast<std::size_t>(p__ * __us.size()))];
+		};
+		std::cout << std::setw(28) << std::left << name__ << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(10) << __us.size() / seconds__
+			<< std::setw(10) << percentile(0.5)
+			<< std::setw(10) << percentile(0.9)
+			<< std::setw(10) << percentile(0.99)
+			<< std::setw(10) << __us.back() << std::endl;
+	}
+};
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu]"};
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v} :
+		sycl::queue{sycl::gpu_selector_v};
+
+	constexpr int jobs_per_client = 200;
+	constexpr std::size_t matrix_size = 64 * 64;
+	constexpr unsigned int image_side = gpu::area_size;
+
+	// a job: every 4th one is an image
+	auto make_matrix = [] (unsigned int seed__)
+	{
+		std::vector<float> values(matrix_size);
+		std::iota(values.begin(), values.end(), static_cast<float>(seed__ % 100));
+		return values;
+	};
+	auto make_image = [] (unsigned int seed__)
+	{
+		std::vector<gpu::color_type> image(image_side * image_side);
+		for (std::size_t i=0; i<image.size(); ++i)
+			image[i] = {static_cast<unsigned char>(i), static_cast<unsigned char>(i >> 8), static_cast<unsigned char>(seed__)};
+		return image;
+	};
+
+	// clients__ threads, each runs jobs_per_client jobs through run_job__ and waits for each result
+	auto load = [&] (const std::string & name__, unsigned int clients__, auto && run_job__)
+	{
+		gpu::latency_report report;
+		std::mutex report_mutex;
+		std::vector<std::thread> threads;
+		auto start = gpu::clock_type::now();
+		for (unsigned int c=0; c<clients__; ++c)
+		{
+			threads.emplace_back(
+				[&, c]
+				{
+					std::vector<double> us;
+					for (int i=0; i<jobs_per_client; ++i)
+					{
+						const unsigned int seed = c * jobs_per_client + i;
+						auto begin = gpu::clock_type::now();
+						run_job__(seed);
+						us.push_back(std::chrono::duration<double, std::micro>(gpu::clock_type::now() - begin).count());
+					}
+					std::lock_guard lock{report_mutex};
+					report.add(us);
+				}
+			);
+		}
+		for (auto & thread: threads)
+			thread.join();
+		const double seconds = std::chrono::duration<double>(gpu::clock_type::now() - start).count();
+		report.print(name__ + ", " + std::to_string(clients__) + " clients", seconds);
+	};
+
+	std::cout << std::setw(28) << std::left << "" << std::right
+		<< std::setw(10) << "jobs/s"
+		<< std::setw(10) << "p50 us"
+		<< std::setw(10) << "p90 us"
+		<< std::setw(10) << "p99 us"
+		<< std::setw(10) << "max us" << std::endl;
+
+	for (unsigned int clients: {1u, 4u, 16u})
+	{
+		// each client calls queue.submit by itself
+		load(
+			"direct",
+			clients,
+			[&] (unsigned int seed__)
+			{
+				if (seed__ % 4 == 3)
+				{
+					auto image = make_image(seed__);
+					std::vector<gpu::color_type> output(image.size());
+					const sycl::range<2> range{image_side, image_side};
+					auto in_buffer = sycl::buffer<gpu::color_type, 2>{image.data(), range};
+					auto out_buffer = sycl::buffer<gpu::color_type, 2>{output.data(), range};
+					queue.submit(
+						[&] (sycl::handler & handler)
+						{
+							auto kernel = gpu::image_piece_rotate_kernel{
+								in_buffer, out_buffer,
+								sycl::range<3>{gpu::block_size, gpu::block_size, gpu::lm_offset},
+								handler
+							};
+							handler.parallel_for(sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}}, kernel);
+						}
+					);
+				}
+				else
+				{
+					auto values = make_matrix(seed__);
+					std::vector<float> output(values.size());
+					const sycl::range<2> range{values.size() / gpu::block_size, gpu::block_size};
+					auto in_buffer = sycl::buffer<float, 2>{values.data(), range};
+					auto out_buffer = sycl::buffer<float, 2>{output.data(), range};
+					queue.submit(
+						[&] (sycl::handler & handler)
+						{
+							gpu::kernel2d_class kernel{in_buffer, out_buffer, handler};
+							handler.parallel_for(sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}}, kernel);
+						}
+					);
+				}
+			}
+		);
+
+		gpu::kernel_service service{queue, 64, 32};
+		load(
+			"kernel_service",
+			clients,
+			[&] (unsigned int seed__)
+			{
+				if (seed__ % 4 == 3)
+					service.piece_rotate(make_image(seed__), image_side, image_side).get();
+				else
+					service.sqrt(make_matrix(seed__)).get();
+			}
+		);
+		std::cout << std::setw(28) << "" << "mean jobs per batch: " << std::setprecision(2) << service.mean_batch() << std::endl;
+	}
+
+	// check one result of each kind
+	gpu::kernel_service service{queue, 8, 8};
+	auto sqrt_result = service.sqrt({1, 4, 9, 16}).get();
+	if (sqrt_result != std::vector<float>{1, 2, 3, 4})
+		throw std::runtime_error{"kernel_service: wrong sqrt result"};
+	auto image = make_image(1);
+	auto rotated = service.piece_rotate(image, image_side, image_side).get();
+	for (unsigned int y=0; y<image_side; ++y)
+		for (unsigned int x=0; x<image_side; ++x)
+			if (rotated[y * image_side + x] != image[x * image_side + y])
+				throw std::runtime_error{"kernel_service: wrong piece rotate result"};
+	std::cout << "results: ok" << std::endl;
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
@@ -0,0 +1,292 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "bundle_cache.hpp"
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+
+using std::string_literals::operator""s;
+
+// Kernel bundle cache
+/*
+	Time from process start to the first result of the sqrt kernel of
+	04-host-access, kernel2d_class of 05-work-group and the piece rotate
+	kernel of 02-ex-ex/03-image-piece-rotate.
+
+	The program starts itself four times:
+		lazy, cold:	no warm up, empty cache directory
+		lazy, warm:	no warm up, the same cache directory again
+		bundle, cold:	gpu::bundle::cache warm up, empty cache directory
+		bundle, warm:	gpu::bundle::cache warm up, the same cache directory
+
+	"lazy" builds each kernel at its first queue.submit. "bundle" builds all
+	three kernels in one executable kernel_bundle before the first submit,
+	and the runtime keeps the binaries in the cache directory for the next
+	process.
+*/
+
+// ./prog [gpu|cpu]
+// ./prog [gpu|cpu] lazy|bundle		(one run)
+
+namespace gpu
+{
+constexpr auto area_size = 256u;
+constexpr auto block_size = 16u;
+constexpr auto lm_offset = 2u;
+
+using color_type = std::array<unsigned char, 3>;
+using clock_type = std::chrono::steady_clock;
+
+// 01-basic-sycl/04-host-access
+template <std::floating_point value_type, unsigned int dimensions>
+class sqrt_kernel
+{
+private:
+	sycl::accessor<value_type, dimensions, sycl::access_mode::read> __input;
+	sycl::accessor<value_type, dimensions, sycl::access_mode::write> __output;
+public:
+	sqrt_kernel(
+		sycl::buffer<value_type, dimensions> & in_buffer__,
+		sycl::buffer<value_type, dimensions> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::item<dimensions> item) const
+	{
+		__output[item.get_id()] = sycl::sqrt(__input[item.get_id()]);
+	}
+};
+
+// 01-basic-sycl/05-work-group
+template <std::floating_point value_type>
+class kernel2d_class
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __output;
+public:
+	kernel2d_class(
+		sycl::buffer<value_type, 2> & in_buffer__,
+		sycl::buffer<value_type, 2> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item__) const
+	{
+		const auto idy = item__.get_global_id(0);
+		const auto idx = item__.get_global_id(1);
+		__output[idy][idx] = sycl::sqrt(__input[idy][idx]);
+	}
+};
+
+// 02-ex-ex/03-image-piece-rotate
+class image_piece_rotate_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	sycl::local_accessor<gpu::color_type, 3> __lm;
+public:
+	image_piece_rotate_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto y_start = static_cast<unsigned int>(gidy/gpu::area_size) * gpu::area_size;
+		auto x_start = static_cast<unsigned int>(gidx/gpu::area_size) * gpu::area_size;
+
+		auto src_gidy = gidx - x_start + y_start;
+		auto src_gidx = gidy - y_start + x_start;
+
+		color_type & lm0 = __lm[lidy][lidx][0];
+
+		lm0 = __input[src_gidy][src_gidx];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		__output[gidy][gidx] = lm0;
+	}
+};
+
+double ms_since(clock_type::time_point start__)
+{
+	return std::chrono::duration<double, std::milli>(clock_type::now() - start__).count();
+}
+
+// One child process: the first result of each kernel.
+void run(const std::string & device_name__, bool bundle__)
+{
+	auto start = gpu::clock_type::now();
+
+	auto device = device_name__ == "cpu" ?
+		sycl::device{sycl::cpu_selector_v} :
+		sycl::device{sycl::gpu_selector_v};
+
+	// before the queue: the cache sets the cache directory of the runtime
+	std::optional<gpu::bundle::cache> cache;
+	if (bundle__)
+		cache.emplace(device);
+
+	sycl::queue queue{device};
+	const double queue_ms = gpu::ms_since(start);
+
+	if (cache)
+	{
+		cache->warm_up<
+			gpu::sqrt_kernel<float, 1u>,
+			gpu::kernel2d_class<float>,
+			gpu::image_piece_rotate_kernel
+		>(queue);
+	}
+	auto use_bundle = [&] (sycl::handler & handler__)
+	{
+		if (cache)
+			cache->use(handler__);
+	};
+
+	std::vector<float> values(gpu::area_size);
+	std::iota(values.begin(), values.end(), 1.0f);
+	std::vector<float> sqrt_output(values.size()), kernel2d_output(values.size());
+	std::vector<gpu::color_type> image(gpu::area_size * gpu::area_size), rotated(image.size());
+	{
+		const sycl::range<1> range1{values.size()};
+		auto in_buffer1 = sycl::buffer<float, 1>{values.data(), range1};
+		auto out_buffer1 = sycl::buffer<float, 1>{sqrt_output.data(), range1};
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				use_bundle(handler);
+				gpu::sqrt_kernel<float, 1u> kernel{in_buffer1, out_buffer1, handler};
+				handler.parallel_for(range1, kernel);
+			}
+		);
+
+		const sycl::range<2> range2{gpu::block_size, values.size() / gpu::block_size};
+		auto in_buffer2 = sycl::buffer<float, 2>{values.data(), range2};
+		auto out_buffer2 = sycl::buffer<float, 2>{kernel2d_output.data(), range2};
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				use_bundle(handler);
+				gpu::kernel2d_class<float> kernel{in_buffer2, out_buffer2, handler};
+				handler.parallel_for(
+					sycl::nd_range<2>{range2, sycl::range<2>{gpu::block_size, gpu::block_size}},
+					kernel
+				);
+			}
+		);
+
+		const sycl::range<2> image_range{gpu::area_size, gpu::area_size};
+		auto in_image = sycl::buffer<gpu::color_type, 2>{image.data(), image_range};
+		auto out_image = sycl::buffer<gpu::color_type, 2>{rotated.data(), image_range};
+		queue.submit(
+			[&] (sycl::handler & handler)
+			{
+				use_bundle(handler);
+				auto piece_rotate = gpu::image_piece_rotate_kernel{
+					in_image,
+					out_image,
+					sycl::range<3>{gpu::block_size, gpu::block_size, gpu::lm_offset},
+					handler
+				};
+				handler.parallel_for(
+					sycl::nd_range<2>{image_range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+					piece_rotate
+				);
+			}
+		);
+	}
+	const double first_result_ms = gpu::ms_since(start);
+
+	if (sqrt_output[3] != 2.0f || kernel2d_output[15] != 4.0f)
+		throw std::runtime_error{"wrong sqrt result"};
+
+	std::cout << std::fixed << std::setprecision(1)
+		<< "\tqueue: " << std::setw(8) << queue_ms << " ms"
+		<< "\twarm up: " << std::setw(8) << (cache ? cache->build_ms() : 0.0) << " ms"
+		<< "\tfirst result: " << std::setw(8) << first_result_ms << " ms";
+	if (cache)
+		std::cout << "\t(" << (cache->warm() ? "cache hit" : "cache miss") << ")";
+	std::cout << std::endl;
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu] [lazy|bundle]"};
+
+	if (argc > 2)
+	{
+		const std::string mode = argv[2];
+		if (mode != "lazy" && mode != "bundle")
+			throw std::runtime_error{""s + argv[0] + " [gpu|cpu] [lazy|bundle]"};
+		gpu::run(device_name, mode == "bundle");
+		return 0;
+	}
+
+	// the cache of the selected device, shared by all child processes
+	gpu::bundle::cache cache{
+		device_name == "cpu" ?
+			sycl::device{sycl::cpu_selector_v} :
+			sycl::device{sycl::gpu_selector_v}
+	};
+	std::cout << "cache: " << cache.directory().string() << std::endl;
+
+	for (const std::string mode: {"lazy", "bundle"})
+	{
+		for (const bool warm: {false, true})
+		{
+			if (! warm)
+				cache.clear();
+			std::cout << mode << ", " << (warm ? "warm" : "cold") << ":" << std::endl;
+			auto start = gpu::clock_type::now();
+			const std::string command = "\""s + argv[0] + "\" " + device_name + " " + mode;
+			if (std::system(command.c_str()) != 0)
+				throw std::runtime_error{"failed: " + command};
+			std::cout << "\tprocess: " << std::fixed << std::setprecision(1) << std::setw(8) << gpu::ms_since(start) << " ms" << std::endl;
+		}
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
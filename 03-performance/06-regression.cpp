@@ -0,0 +1,571 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <array>
+#include <map>
+#include <random>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+using std::string_literals::operator""s;
+
+// Regression check
+/*
+	Runs the kernels of
+		01-basic-sycl/04-host-access		(sqrt)
+		02-ex-ex/01-matrix-addition
+		02-ex-ex/02-matrix-multiplication
+		02-ex-ex/03-image-piece-rotate
+	against host reference implementations:
+		+ the "// output:" blocks of 01-matrix-addition and
+		  02-matrix-multiplication, as fixed cases
+		+ edge sizes (one work-group, non power of two sizes, large sizes)
+		+ random data from a fixed seed, so every run checks the same values
+	sqrt is compared with a relative tolerance, the other kernels exactly.
+
+	Every case is timed too (best of 5 runs, submit to result on the host).
+	Throughput is checked only when a baseline file of "case items/s" lines
+	is given: a case fails if its throughput is below baseline * (1 -
+	threshold). Cases faster than gpu::min_timed_seconds are too short to
+	time reliably and are never checked. "update" writes the baseline file;
+	a missing baseline file is an error, it is not written implicitly.
+
+	The kernels are copied unchanged from their examples. The exit code is
+	the number of failed cases (at most 255). b2 runs it on the cpu device
+	without a baseline file as a test (run rule in the jamfile): the build
+	fails on a wrong result, never on machine noise.
+*/
+
+// ./prog [gpu|cpu] [baseline-file [threshold] [update]]
+// ./prog cpu						correctness only
+// ./prog cpu regression-cpu.txt 0.2 update	write the baseline
+// ./prog cpu regression-cpu.txt 0.2		correctness and throughput
+
+namespace gpu
+{
+constexpr auto area_size = 256u;
+constexpr auto block_size = 16u;
+constexpr auto lm_offset = 2u;
+
+using color_type = std::array<unsigned char, 3>;
+using clock_type = std::chrono::steady_clock;
+
+// 01-basic-sycl/04-host-access
+template <std::floating_point value_type, unsigned int dimensions>
+class sqrt_kernel
+{
+private:
+	sycl::accessor<value_type, dimensions, sycl::access_mode::read> __input;
+	sycl::accessor<value_type, dimensions, sycl::access_mode::write> __output;
+public:
+	sqrt_kernel(
+		sycl::buffer<value_type, dimensions> & in_buffer__,
+		sycl::buffer<value_type, dimensions> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::item<dimensions> item) const
+	{
+		__output[item.get_id()] = sycl::sqrt(__input[item.get_id()]);
+	}
+};
+
+// 02-ex-ex/01-matrix-addition
+template <typename value_type>
+class addition_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+	sycl::local_accessor<value_type, 3> __lm;
+public:
+	addition_kernel(
+		sycl::buffer<value_type, 2> & matrix0__,
+		sycl::buffer<value_type, 2> & matrix1__,
+		sycl::buffer<value_type, 2> & matrix2__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__matrix0{matrix0__, handler__, sycl::read_only},
+		__matrix1{matrix1__, handler__, sycl::read_only},
+		__matrix2{matrix2__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gid_j = item.get_global_id(0);
+		auto gid_i = item.get_global_id(1);
+		auto lid_j = item.get_local_id(0);
+		auto lid_i = item.get_local_id(1);
+
+		const value_type & m0_value = __matrix0[gid_j][gid_i];
+		const value_type & m1_value = __matrix1[gid_j][gid_i];
+		value_type & m2_value = __matrix2[gid_j][gid_i];
+		value_type & lm0 = __lm[lid_j][lid_i][0];
+		value_type & lm1 = __lm[lid_j][lid_i][1];
+		value_type & lm2 = __lm[lid_j][lid_i][2];
+
+		lm0 = 0;
+		lm1 = 0;
+		lm2 = 0;
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		lm0 = m0_value;
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		lm1 = m1_value;
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		lm2 = lm0 + lm1;
+		m2_value = lm2;
+	}
+};
+
+// 02-ex-ex/02-matrix-multiplication
+template <typename value_type>
+class multiplication_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+	sycl::local_accessor<value_type, 3> __lm;
+public:
+	multiplication_kernel(
+		sycl::buffer<value_type, 2> & m0__,
+		sycl::buffer<value_type, 2> & m1__,
+		sycl::buffer<value_type, 2> & m2__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__matrix0{m0__, handler__, sycl::read_only},
+		__matrix1{m1__, handler__, sycl::read_only},
+		__matrix2{m2__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto gsizey = item.get_global_range()[0];
+		auto gsizex = item.get_global_range()[1];
+
+		if (gsizey != gsizex)
+		{
+			__matrix2[gidy][gidx] = 999;	// indicate error
+			return;
+		}
+
+		for (int i=0; i<gsizex; ++i)
+			__lm[lidy][lidx][i] = __matrix0[gidy][i];
+
+		for (int j=0; j<gsizey; ++j)
+			__lm[lidy][lidx][j+gsizex] = __matrix1[j][gidx];
+
+		value_type & sum = __lm[lidy][lidx][0 + gsizey + gsizex];
+		sum = 0;
+
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		for (int i0=0; i0<gsizex; ++i0)
+		{
+			int i1 = i0 + gsizex;
+			sum += __lm[lidy][lidx][i0] * __lm[lidy][lidx][i1];
+		}
+
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		__matrix2[gidy][gidx] = sum;
+	}
+};
+
+// 02-ex-ex/03-image-piece-rotate
+class image_piece_rotate_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	sycl::local_accessor<gpu::color_type, 3> __lm;
+public:
+	image_piece_rotate_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto y_start = static_cast<unsigned int>(gidy/gpu::area_size) * gpu::area_size;
+		auto x_start = static_cast<unsigned int>(gidx/gpu::area_size) * gpu::area_size;
+
+		auto src_gidy = gidx - x_start + y_start;
+		auto src_gidx = gidy - y_start + x_start;
+
+		color_type & lm0 = __lm[lidy][lidx][0];
+
+		lm0 = __input[src_gidy][src_gidx];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		__output[gidy][gidx] = lm0;
+	}
+};
+
+// device runs: input in, result out
+std::vector<float> run_sqrt(sycl::queue & queue__, std::vector<float> input__)
+{
+	std::vector<float> output(input__.size());
+	const sycl::range<1> range{input__.size()};
+	{
+		auto in_buffer = sycl::buffer<float, 1>{input__.data(), range};
+		auto out_buffer = sycl::buffer<float, 1>{output.data(), range};
+		queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				gpu::sqrt_kernel<float, 1u> kernel{in_buffer, out_buffer, handler};
+				handler.parallel_for(range, kernel);
+			}
+		);
+	}
+	return output;
+}
+
+template <template <typename> typename kernel_type, typename value_type>
+std::vector<value_type> run_matrix(
+	sycl::queue & queue__,
+	std::vector<value_type> m0__,
+	std::vector<value_type> m1__,
+	std::size_t rows__,
+	std::size_t cols__,
+	std::size_t lm_offset__
+)
+{
+	std::vector<value_type> m2(rows__ * cols__);
+	const sycl::range<2> range{rows__, cols__};
+	const sycl::range<2> local{2, 2};
+	{
+		auto m0_buff = sycl::buffer<value_type, 2>{m0__.data(), range};
+		auto m1_buff = sycl::buffer<value_type, 2>{m1__.data(), range};
+		auto m2_buff = sycl::buffer<value_type, 2>{m2.data(), range};
+		queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				auto kernel = kernel_type<value_type>{
+					m0_buff,
+					m1_buff,
+					m2_buff,
+					sycl::range<3>{local[0], local[1], lm_offset__},
+					handler
+				};
+				handler.parallel_for(sycl::nd_range<2>{range, local}, kernel);
+			}
+		);
+	}
+	return m2;
+}
+
+std::vector<color_type> run_piece_rotate(sycl::queue & queue__, std::vector<color_type> image__, std::size_t width__, std::size_t height__)
+{
+	std::vector<color_type> output(image__.size());
+	const sycl::range<2> range{height__, width__};
+	{
+		auto in_buffer = sycl::buffer<gpu::color_type, 2>{image__.data(), range};
+		auto out_buffer = sycl::buffer<gpu::color_type, 2>{output.data(), range};
+		queue__.submit(
+			[&] (sycl::handler & handler)
+			{
+				auto piece_rotate = gpu::image_piece_rotate_kernel{
+					in_buffer,
+					out_buffer,
+					sycl::range<3>{gpu::block_size, gpu::block_size, gpu::lm_offset},
+					handler
+				};
+				handler.parallel_for(
+					sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+					piece_rotate
+				);
+			}
+		);
+	}
+	return output;
+}
+
+// host references
+template <typename value_type>
+std::vector<value_type> reference_multiplication(const std::vector<value_type> & m0__, const std::vector<value_type> & m1__, std::size_t dim__)
+{
+	std::vector<value_type> m2(dim__ * dim__);
+	for (std::size_t y=0; y<dim__; ++y)
+		for (std::size_t x=0; x<dim__; ++x)
+			for (std::size_t k=0; k<dim__; ++k)
+				m2[y * dim__ + x] += m0__[y * dim__ + k] * m1__[k * dim__ + x];
+	return m2;
+}
+
+std::vector<color_type> reference_piece_rotate(const std::vector<color_type> & image__, std::size_t width__, std::size_t height__)
+{
+	std::vector<color_type> output(image__.size());
+	for (std::size_t y=0; y<height__; ++y)
+	{
+		for (std::size_t x=0; x<width__; ++x)
+		{
+			const std::size_t y_start = y / gpu::area_size * gpu::area_size;
+			const std::size_t x_start = x / gpu::area_size * gpu::area_size;
+			output[y * width__ + x] = image__[(x - x_start + y_start) * width__ + (y - y_start + x_start)];
+		}
+	}
+	return output;
+}
+
+// A case faster than this is not compared with the baseline.
+constexpr double min_timed_seconds = 1e-3;
+
+class suite
+{
+private:
+	std::map<std::string, double> __baseline;	// case -> items/s, empty: correctness only
+	std::map<std::string, double> __measured;
+	double __threshold;
+	int __failures = 0;
+public:
+	suite(const std::map<std::string, double> & baseline__, double threshold__):
+		__baseline{baseline__},
+		__threshold{threshold__}
+	{
+		std::cout << std::setw(32) << std::left << "case" << std::right
+			<< std::setw(8) << "result"
+			<< std::setw(12) << "max error"
+			<< std::setw(12) << "Mitems/s"
+			<< std::setw(12) << "baseline"
+			<< std::setw(10) << "change" << std::endl;
+	}
+public:
+	// error__: largest difference to the reference; run__ is timed for items__ items
+	void check(const std::string & name__, double error__, double tolerance__, std::size_t items__, const std::function<void()> & run__)
+	{
+		std::vector<double> seconds;
+		for (int i=0; i<5; ++i)
+		{
+			auto start = clock_type::now();
+			run__();
+			seconds.push_back(std::chrono::duration<double>(clock_type::now() - start).count());
+		}
+		const double best = *std::min_element(seconds.begin(), seconds.end());
+		const double items_per_second = items__ / best;
+		__measured[name__] = items_per_second;
+
+		bool correct = error__ <= tolerance__;
+		bool fast = true;
+		std::cout << std::setw(32) << std::left << name__ << std::right
+			<< std::setw(8) << (correct ? "ok" : "WRONG")
+			<< std::setw(12) << std::scientific << std::setprecision(2) << error__
+			<< std::setw(12) << std::fixed << items_per_second * 1e-6;
+		if (auto it = __baseline.find(name__); it != __baseline.end() && best < gpu::min_timed_seconds)
+		{
+			std::cout << std::setw(12) << it->second * 1e-6 << "  too short to time";
+		}
+		else if (it != __baseline.end())
+		{
+			const double change = items_per_second / it->second - 1;
+			fast = change >= -__threshold;
+			std::cout << std::setw(12) << it->second * 1e-6
+				<< std::setw(9) << std::showpos << change * 100 << std::noshowpos << "%"
+				<< (fast ? "" : "  SLOWER");
+		}
+		std::cout << std::endl;
+		if (! correct || ! fast)
+			++__failures;
+	}
+	int failures() const
+	{
+		return __failures;
+	}
+	const std::map<std::string, double> & measured() const
+	{
+		return __measured;
+	}
+};
+
+std::map<std::string, double> read_baseline(const std::string & path__)
+{
+	std::map<std::string, double> baseline;
+	std::ifstream file{path__};
+	std::string name;
+	double value;
+	while (file >> name >> value)
+		baseline[name] = value;
+	return baseline;
+}
+
+void write_baseline(const std::string & path__, const std::map<std::string, double> & measured__)
+{
+	std::ofstream file{path__};
+	if (! file)
+		throw std::runtime_error{"can not write " + path__};
+	for (const auto & [name, value]: measured__)
+		file << name << " " << std::fixed << std::setprecision(0) << value << "\n";
+}
+
+template <typename value_type>
+double max_difference(const std::vector<value_type> & a__, const std::vector<value_type> & b__)
+{
+	double error = 0;
+	for (std::size_t i=0; i<a__.size(); ++i)
+		error = std::max(error, std::abs(static_cast<double>(a__[i]) - static_cast<double>(b__[i])));
+	return error;
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu] [baseline-file [threshold] [update]]"};
+	const std::string baseline_path = argc > 2 ? argv[2] : "";
+	const double threshold = argc > 3 ? std::stod(argv[3]) : 0.2;
+	const bool update = argc > 4 && argv[4] == "update"s;
+
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v} :
+		sycl::queue{sycl::gpu_selector_v};
+
+	const auto baseline = update || baseline_path.empty() ? std::map<std::string, double>{} : gpu::read_baseline(baseline_path);
+	if (! update && ! baseline_path.empty() && baseline.empty())
+		throw std::runtime_error{"No baseline in " + baseline_path + ", write it first: "s + argv[0] + " " + device_name + " " + baseline_path + " " + std::to_string(threshold) + " update"};
+	gpu::suite suite{baseline, threshold};
+	std::mt19937 random{20240101};
+
+	// sqrt: 0, 1, perfect squares, random values over many magnitudes
+	for (std::size_t size: {1uz, 7uz, 1023uz, 1uz << 20})
+	{
+		std::vector<float> input(size);
+		std::uniform_real_distribution<float> exponent{-30.0f, 30.0f};
+		for (std::size_t i=0; i<size; ++i)
+			input[i] = i < 4 ? static_cast<float>(i * i) : std::exp2(exponent(random));
+		auto output = gpu::run_sqrt(queue, input);
+		double error = 0;
+		for (std::size_t i=0; i<size; ++i)
+		{
+			const double expected = std::sqrt(static_cast<double>(input[i]));
+			error = std::max(error, std::abs(output[i] - expected) / std::max(expected, 1e-30));
+		}
+		suite.check("sqrt-" + std::to_string(size), error, 1e-6, size, [&] { gpu::run_sqrt(queue, input); });
+	}
+
+	// matrix addition: the output of 01-matrix-addition, then random sizes
+	{
+		const std::vector<float> m0{1,2,3,4, 3,2,4,2, -1,-3,-2,1, 7,8,4,-3};
+		const std::vector<float> m1{3,2,-7,5, 2,-3,-5,1, 4,5,7,-2, 9,11,-7,-8};
+		const std::vector<float> expected{4,4,-4,9, 5,-1,-1,3, 3,2,5,-1, 16,19,-3,-11};
+		auto m2 = gpu::run_matrix<gpu::addition_kernel>(queue, m0, m1, 4, 4, 3);
+		suite.check("addition-output-4x4", gpu::max_difference(m2, expected), 0, 16, [&] { gpu::run_matrix<gpu::addition_kernel>(queue, m0, m1, 4, 4, 3); });
+	}
+	for (auto [rows, cols]: std::vector<std::array<std::size_t, 2>>{{2, 2}, {6, 10}, {64, 130}, {1024, 1024}})
+	{
+		std::uniform_int_distribution<int> value{-1000, 1000};
+		std::vector<float> m0(rows * cols), m1(rows * cols), expected(rows * cols);
+		for (std::size_t i=0; i<m0.size(); ++i)
+		{
+			m0[i] = value(random);
+			m1[i] = value(random);
+			expected[i] = m0[i] + m1[i];
+		}
+		auto m2 = gpu::run_matrix<gpu::addition_kernel>(queue, m0, m1, rows, cols, 3);
+		suite.check(
+			"addition-" + std::to_string(rows) + "x" + std::to_string(cols),
+			gpu::max_difference(m2, expected), 0, rows * cols,
+			[&] { gpu::run_matrix<gpu::addition_kernel>(queue, m0, m1, rows, cols, 3); }
+		);
+	}
+
+	// matrix multiplication: the output of 02-matrix-multiplication, then random sizes
+	{
+		const std::vector<int> m0{1,2,3,4, 3,2,-1,-2, -2,2,3,2, 4,2,-3,4};
+		const std::vector<int> m1{2,1,-2,-3, 3,2,4,5, 2,-2,3,4, -2,-3,-3,-4};
+		const std::vector<int> expected{6,-13,3,3, 14,15,5,5, 4,-10,15,20, 0,2,-21,-30};
+		auto m2 = gpu::run_matrix<gpu::multiplication_kernel>(queue, m0, m1, 4, 4, 9);
+		suite.check("multiplication-output-4x4", gpu::max_difference(m2, expected), 0, 16 * 4, [&] { gpu::run_matrix<gpu::multiplication_kernel>(queue, m0, m1, 4, 4, 9); });
+	}
+	for (std::size_t dim: {2uz, 6uz, 34uz, 128uz})
+	{
+		std::uniform_int_distribution<int> value{-9, 9};
+		std::vector<int> m0(dim * dim), m1(dim * dim);
+		for (std::size_t i=0; i<m0.size(); ++i)
+		{
+			m0[i] = value(random);
+			m1[i] = value(random);
+		}
+		auto expected = gpu::reference_multiplication(m0, m1, dim);
+		auto m2 = gpu::run_matrix<gpu::multiplication_kernel>(queue, m0, m1, dim, dim, 2 * dim + 1);
+		suite.check(
+			"multiplication-" + std::to_string(dim) + "x" + std::to_string(dim),
+			gpu::max_difference(m2, expected), 0, dim * dim * dim,
+			[&] { gpu::run_matrix<gpu::multiplication_kernel>(queue, m0, m1, dim, dim, 2 * dim + 1); }
+		);
+	}
+
+	// piece rotate: one area, areas side by side, areas on top of each other
+	for (auto [width, height]: std::vector<std::array<std::size_t, 2>>{{256, 256}, {768, 256}, {256, 512}, {2048, 1536}})
+	{
+		std::uniform_int_distribution<int> value{0, 255};
+		std::vector<gpu::color_type> image(width * height);
+		for (auto & color: image)
+			color = {static_cast<unsigned char>(value(random)), static_cast<unsigned char>(value(random)), static_cast<unsigned char>(value(random))};
+		auto expected = gpu::reference_piece_rotate(image, width, height);
+		auto output = gpu::run_piece_rotate(queue, image, width, height);
+		suite.check(
+			"piece-rotate-" + std::to_string(width) + "x" + std::to_string(height),
+			output == expected ? 0 : 1, 0, width * height,
+			[&] { gpu::run_piece_rotate(queue, image, width, height); }
+		);
+	}
+
+	if (update && ! baseline_path.empty())
+	{
+		gpu::write_baseline(baseline_path, suite.measured());
+		std::cout << "baseline written: " << baseline_path << std::endl;
+	}
+	std::cout << suite.failures() << " failed" << std::endl;
+	return std::min(suite.failures(), 255);
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+	return -1;
+}
@@ -0,0 +1,629 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <limits>
+
+using std::string_literals::operator""s;
+
+// Roofline
+/*
+	Measures what the selected device can do:
+		+ global memory bandwidth: stream copy, scale, add, triad
+		+ local memory bandwidth: reads of a sycl::local_accessor
+		+ group_barrier cost: a loop with and without barriers
+		+ atomic throughput: one counter for all, one counter per work-group
+		+ peak flop/s: chains of fma, for float, and double / half if the
+		  device has them
+
+	Then it runs the kernels of the examples and puts each one on the
+	roofline: attainable = min(peak flop/s, intensity * peak bandwidth).
+	The intensity is flops per byte the kernel loads and stores in global
+	memory (without caches), so a kernel far below its roof is limited by
+	something else: latency, local memory, barriers, launch size.
+
+	All times are device times from event profiling, best of 5 runs.
+*/
+
+// ./prog [gpu|cpu]
+
+namespace gpu
+{
+constexpr auto area_size = 256u;
+constexpr auto block_size = 16u;
+constexpr auto lm_offset = 2u;
+constexpr int tile = 16;
+constexpr int runs = 5;
+constexpr int inner_iterations = 256;
+
+using color_type = std::array<unsigned char, 3>;
+
+// Best device time of gpu::runs launches of cgf__, in seconds. The first
+// launch is a warm up.
+template <typename cgf_type>
+double device_seconds(sycl::queue & queue__, cgf_type && cgf__)
+{
+	queue__.submit(cgf__).wait();
+	double best = std::numeric_limits<double>::max();
+	for (int i=0; i<gpu::runs; ++i)
+	{
+		auto event = queue__.submit(cgf__);
+		event.wait();
+		const auto start = event.template get_profiling_info<sycl::info::event_profiling::command_start>();
+		const auto end = event.template get_profiling_info<sycl::info::event_profiling::command_end>();
+		best = std::min(best, (end - start) * 1e-9);
+	}
+	return best;
+}
+
+void report(const std::string & name__, double value__, const std::string & unit__)
+{
+	std::cout << std::setw(36) << std::left << name__ << std::right << std::setw(12)
+		<< std::fixed << std::setprecision(2) << value__ << " " << unit__ << std::endl;
+}
+
+// Each work-item reads inner_iterations values of local memory.
+class local_bandwidth_kernel
+{
+private:
+	float * __output;
+	sycl::local_accessor<float, 1> __lm;
+public:
+	local_bandwidth_kernel(float * output__, std::size_t local_size__, sycl::handler & handler__):
+		__output{output__},
+		__lm{sycl::range<1>{local_size__}, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<1> item) const
+	{
+		const auto lid = item.get_local_id(0);
+		const auto mask = item.get_local_range(0) - 1;
+		__lm[lid] = static_cast<float>(lid);
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		float sum = 0;
+		#pragma unroll 8
+		for (int i=0; i<gpu::inner_iterations; ++i)
+			sum += __lm[(lid + i * 33) & mask];
+		__output[item.get_global_id(0)] = sum;
+	}
+};
+
+// inner_iterations rounds of local memory work, with or without a barrier per round.
+// Ping-pong between two local arrays: a round reads one and writes the other,
+// so with the barrier no work-item writes what a neighbour still reads. Without
+// the barrier a work-item only reads its own slot: the same work, no race.
+template <bool with_barrier>
+class barrier_kernel
+{
+private:
+	float * __output;
+	sycl::local_accessor<float, 2> __lm;
+public:
+	barrier_kernel(float * output__, std::size_t local_size__, sycl::handler & handler__):
+		__output{output__},
+		__lm{sycl::range<2>{2, local_size__}, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<1> item) const
+	{
+		const auto lid = item.get_local_id(0);
+		const auto size = item.get_local_range(0);
+		const auto next = with_barrier ? (lid + 1) % size : lid;
+		__lm[0][lid] = 1;
+		for (int i=0; i<gpu::inner_iterations; ++i)
+		{
+			if constexpr (with_barrier)
+				sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+			const auto from = i & 1;
+			__lm[from ^ 1][lid] = __lm[from][lid] + __lm[from][next] * 0.5f;
+		}
+		__output[item.get_global_id(0)] = __lm[gpu::inner_iterations & 1][lid];
+	}
+};
+
+// 8 independent fma chains per work-item
+template <typename value_type>
+class fma_kernel
+{
+private:
+	value_type * __output;
+	value_type __b, __c;
+public:
+	fma_kernel(value_type * output__, value_type b__, value_type c__):
+		__output{output__}, __b{b__}, __c{c__}
+	{
+	}
+public:
+	static constexpr int chains = 8;
+	void operator()(sycl::item<1> item) const
+	{
+		value_type a[chains];
+		#pragma unroll
+		for (int k=0; k<chains; ++k)
+			a[k] = static_cast<value_type>(item.get_id(0) + k);
+		for (int i=0; i<gpu::inner_iterations; ++i)
+		{
+			#pragma unroll
+			for (int k=0; k<chains; ++k)
+				a[k] = sycl::fma(a[k], __b, __c);
+		}
+		value_type sum = 0;
+		#pragma unroll
+		for (int k=0; k<chains; ++k)
+			sum += a[k];
+		__output[item.get_id(0)] = sum;
+	}
+};
+
+// 01-basic-sycl/04-host-access
+template <std::floating_point value_type, unsigned int dimensions>
+class sqrt_kernel
+{
+private:
+	sycl::accessor<value_type, dimensions, sycl::access_mode::read> __input;
+	sycl::accessor<value_type, dimensions, sycl::access_mode::write> __output;
+public:
+	sqrt_kernel(
+		sycl::buffer<value_type, dimensions> & in_buffer__,
+		sycl::buffer<value_type, dimensions> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::item<dimensions> item) const
+	{
+		__output[item.get_id()] = sycl::sqrt(__input[item.get_id()]);
+	}
+};
+
+// 02-ex-ex/01-matrix-addition
+template <typename value_type>
+class addition_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+	sycl::local_accessor<value_type, 3> __lm;
+public:
+	addition_kernel(
+		sycl::buffer<value_type, 2> & matrix0__,
+		sycl::buffer<value_type, 2> & matrix1__,
+		sycl::buffer<value_type, 2> & matrix2__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__matrix0{matrix0__, handler__, sycl::read_only},
+		__matrix1{matrix1__, handler__, sycl::read_only},
+		__matrix2{matrix2__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gid_j = item.get_global_id(0);
+		auto gid_i = item.get_global_id(1);
+		auto lid_j = item.get_local_id(0);
+		auto lid_i = item.get_local_id(1);
+
+		value_type & lm0 = __lm[lid_j][lid_i][0];
+		value_type & lm1 = __lm[lid_j][lid_i][1];
+		value_type & lm2 = __lm[lid_j][lid_i][2];
+
+		lm0 = 0;
+		lm1 = 0;
+		lm2 = 0;
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		lm0 = __matrix0[gid_j][gid_i];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		lm1 = __matrix1[gid_j][gid_i];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		lm2 = lm0 + lm1;
+		__matrix2[gid_j][gid_i] = lm2;
+	}
+};
+
+// 02-ex-ex/02-matrix-multiplication
+template <typename value_type>
+class multiplication_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+	sycl::local_accessor<value_type, 3> __lm;
+public:
+	multiplication_kernel(
+		sycl::buffer<value_type, 2> & m0__,
+		sycl::buffer<value_type, 2> & m1__,
+		sycl::buffer<value_type, 2> & m2__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__matrix0{m0__, handler__, sycl::read_only},
+		__matrix1{m1__, handler__, sycl::read_only},
+		__matrix2{m2__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto gsizey = item.get_global_range()[0];
+		auto gsizex = item.get_global_range()[1];
+
+		if (gsizey != gsizex)
+		{
+			__matrix2[gidy][gidx] = 999;	// indicate error
+			return;
+		}
+
+		// else
+
+		// copy the row from first matrix to lm
+		for (int i=0; i<gsizex; ++i)
+			__lm[lidy][lidx][i] = __matrix0[gidy][i];
+
+		// copy the column from second matrix to lm
+		for (int j=0; j<gsizey; ++j)
+			__lm[lidy][lidx][j+gsizex] = __matrix1[j][gidx];
+
+		// alias
+		value_type & sum = __lm[lidy][lidx][0 + gsizey + gsizex];
+		// Init the last value of lm to 0.
+		sum = 0;
+
+		// synchronize now
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		// do multiplication addition
+		for (int i0=0; i0<gsizex; ++i0)
+		{
+			int i1 = i0 + gsizex;
+			sum += __lm[lidy][lidx][i0] * __lm[lidy][lidx][i1];
+		}
+
+		// synchronize now
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		// copy result from local memory to host memory
+		__matrix2[gidy][gidx] = sum;
+	}
+};
+
+// 02-ex-ex/05-matrix-multiplication-strassen, c = a x b, dim is N * tile
+class gemm_kernel
+{
+private:
+	const float * __a;
+	const float * __b;
+	float * __c;
+	int __dim;
+	sycl::local_accessor<float, 2> __tile_a;
+	sycl::local_accessor<float, 2> __tile_b;
+public:
+	gemm_kernel(const float * a__, const float * b__, float * c__, int dim__, sycl::handler & handler__):
+		__a{a__}, __b{b__}, __c{c__}, __dim{dim__},
+		__tile_a{sycl::range<2>{gpu::tile, gpu::tile}, handler__},
+		__tile_b{sycl::range<2>{gpu::tile, gpu::tile}, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		const int gidy = item.get_global_id(0);
+		const int gidx = item.get_global_id(1);
+		const int lidy = item.get_local_id(0);
+		const int lidx = item.get_local_id(1);
+
+		float sum = 0;
+		for (int t=0; t<__dim; t+=gpu::tile)
+		{
+			__tile_a[lidy][lidx] = __a[gidy * __dim + t + lidx];
+			__tile_b[lidy][lidx] = __b[(t + lidy) * __dim + gidx];
+			sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+			#pragma unroll
+			for (int i=0; i<gpu::tile; ++i)
+				sum += __tile_a[lidy][i] * __tile_b[i][lidx];
+			sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		}
+		__c[gidy * __dim + gidx] = sum;
+	}
+};
+
+// 02-ex-ex/03-image-piece-rotate
+class image_piece_rotate_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	sycl::local_accessor<gpu::color_type, 3> __lm;
+public:
+	image_piece_rotate_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto y_start = static_cast<unsigned int>(gidy/gpu::area_size) * gpu::area_size;
+		auto x_start = static_cast<unsigned int>(gidx/gpu::area_size) * gpu::area_size;
+
+		auto src_gidy = gidx - x_start + y_start;
+		auto src_gidx = gidy - y_start + x_start;
+
+		color_type & lm0 = __lm[lidy][lidx][0];
+
+		lm0 = __input[src_gidy][src_gidx];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		__output[gidy][gidx] = lm0;
+	}
+};
+
+class roofline
+{
+private:
+	double __peak_flops;
+	double __peak_bytes;
+public:
+	roofline(double peak_flops__, double peak_bytes__):
+		__peak_flops{peak_flops__},
+		__peak_bytes{peak_bytes__}
+	{
+		std::cout << "\nridge point: " << std::setprecision(2) << __peak_flops / __peak_bytes << " flop/byte\n\n"
+			<< std::setw(32) << std::left << "kernel" << std::right
+			<< std::setw(10) << "flop/byte"
+			<< std::setw(10) << "GFLOP/s"
+			<< std::setw(10) << "GB/s"
+			<< std::setw(10) << "roof"
+			<< std::setw(8) << "%roof"
+			<< "  bound" << std::endl;
+	}
+public:
+	void place(const std::string & name__, double flops__, double bytes__, double seconds__) const
+	{
+		const double intensity = flops__ / bytes__;
+		const double roof = std::min(__peak_flops, intensity * __peak_bytes);
+		const double achieved = flops__ / seconds__;
+		// without flops, the roof is the bandwidth
+		const double percent = flops__ > 0 ? achieved / roof * 100 : bytes__ / seconds__ / __peak_bytes * 100;
+		std::cout << std::setw(32) << std::left << name__ << std::right << std::fixed
+			<< std::setw(10) << std::setprecision(3) << intensity
+			<< std::setw(10) << std::setprecision(2) << achieved * 1e-9
+			<< std::setw(10) << bytes__ / seconds__ * 1e-9
+			<< std::setw(10) << roof * 1e-9
+			<< std::setw(7) << std::setprecision(1) << percent << "%"
+			<< "  " << (intensity * __peak_bytes < __peak_flops ? "memory" : "compute") << std::endl;
+	}
+};
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu]"};
+	const sycl::property_list props{sycl::property::queue::enable_profiling{}};
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v, props} :
+		sycl::queue{sycl::gpu_selector_v, props};
+
+	const auto device = queue.get_device();
+	std::cout << device.get_info<sycl::info::device::name>() << "\n"
+		<< "compute units: " << device.get_info<sycl::info::device::max_compute_units>() << "\n"
+		<< "local memory: " << device.get_info<sycl::info::device::local_mem_size>() / 1024 << " KiB\n\n";
+
+	// largest power of two work-group up to 256
+	std::size_t local_size = 1;
+	while (local_size * 2 <= std::min<std::size_t>(256, device.get_info<sycl::info::device::max_work_group_size>()))
+		local_size *= 2;
+
+	// 3 stream arrays of up to 128 MiB each
+	const std::size_t max_alloc = device.get_info<sycl::info::device::max_mem_alloc_size>();
+	const std::size_t n = std::min<std::size_t>(1u << 25, max_alloc / sizeof(float)) / local_size * local_size;
+	float * a = sycl::malloc_device<float>(n, queue);
+	float * b = sycl::malloc_device<float>(n, queue);
+	float * c = sycl::malloc_device<float>(n, queue);
+	queue.fill(a, 1.0f, n);
+	queue.fill(b, 2.0f, n);
+	queue.fill(c, 0.0f, n).wait();
+
+	// stream
+	const float scalar = 3.0f;
+	const double copy_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(sycl::range<1>{n}, [=] (sycl::id<1> i) { c[i] = a[i]; });
+	});
+	const double scale_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(sycl::range<1>{n}, [=] (sycl::id<1> i) { b[i] = scalar * c[i]; });
+	});
+	const double add_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(sycl::range<1>{n}, [=] (sycl::id<1> i) { c[i] = a[i] + b[i]; });
+	});
+	const double triad_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(sycl::range<1>{n}, [=] (sycl::id<1> i) { a[i] = b[i] + scalar * c[i]; });
+	});
+	const double bytes2 = 2.0 * n * sizeof(float), bytes3 = 3.0 * n * sizeof(float);
+	gpu::report("stream copy", bytes2 / copy_s * 1e-9, "GB/s");
+	gpu::report("stream scale", bytes2 / scale_s * 1e-9, "GB/s");
+	gpu::report("stream add", bytes3 / add_s * 1e-9, "GB/s");
+	gpu::report("stream triad", bytes3 / triad_s * 1e-9, "GB/s");
+	const double peak_bytes = std::max({bytes2 / copy_s, bytes2 / scale_s, bytes3 / add_s, bytes3 / triad_s});
+
+	// local memory, barriers
+	const sycl::nd_range<1> nd_range{sycl::range<1>{n}, sycl::range<1>{local_size}};
+	const double local_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(nd_range, gpu::local_bandwidth_kernel{c, local_size, handler});
+	});
+	gpu::report("local memory read", n * gpu::inner_iterations * sizeof(float) / local_s * 1e-9, "GB/s");
+
+	const std::size_t barrier_items = std::min<std::size_t>(n, 1u << 20);
+	const sycl::nd_range<1> barrier_range{sycl::range<1>{barrier_items}, sycl::range<1>{local_size}};
+	const double without_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(barrier_range, gpu::barrier_kernel<false>{c, local_size, handler});
+	});
+	const double with_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(barrier_range, gpu::barrier_kernel<true>{c, local_size, handler});
+	});
+	gpu::report("group_barrier, all groups", std::max(0.0, with_s - without_s) / gpu::inner_iterations * 1e9, "ns");
+	gpu::report("group_barrier, per work-group", std::max(0.0, with_s - without_s) / (gpu::inner_iterations * (barrier_items / local_size)) * 1e9, "ns");
+
+	// atomics
+	auto * counters = sycl::malloc_device<unsigned int>(n / local_size, queue);
+	queue.fill(counters, 0u, n / local_size).wait();
+	const std::size_t atomic_items = std::min<std::size_t>(n, 1u << 22);
+	const double contended_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(sycl::range<1>{atomic_items}, [=] (sycl::id<1>) {
+			sycl::atomic_ref<unsigned int, sycl::memory_order::relaxed, sycl::memory_scope::device> counter{counters[0]};
+			counter.fetch_add(1u);
+		});
+	});
+	const double spread_s = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+		handler.parallel_for(sycl::nd_range<1>{sycl::range<1>{atomic_items}, sycl::range<1>{local_size}}, [=] (sycl::nd_item<1> item) {
+			sycl::atomic_ref<unsigned int, sycl::memory_order::relaxed, sycl::memory_scope::device> counter{counters[item.get_group(0)]};
+			counter.fetch_add(1u);
+		});
+	});
+	gpu::report("atomic add, one counter", atomic_items / contended_s * 1e-9, "G/s");
+	gpu::report("atomic add, counter per work-group", atomic_items / spread_s * 1e-9, "G/s");
+
+	// peak flops
+	const std::size_t fma_items = std::min<std::size_t>(n, 1u << 20);
+	auto peak = [&] <typename value_type> (const std::string & name__)
+	{
+		auto * output = sycl::malloc_device<value_type>(fma_items, queue);
+		const double seconds = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+			handler.parallel_for(
+				sycl::range<1>{fma_items},
+				gpu::fma_kernel<value_type>{output, static_cast<value_type>(0.999f), static_cast<value_type>(0.001f)}
+			);
+		});
+		sycl::free(output, queue);
+		const double flops = 2.0 * fma_items * gpu::inner_iterations * gpu::fma_kernel<value_type>::chains / seconds;
+		gpu::report("peak " + name__, flops * 1e-9, "GFLOP/s");
+		return flops;
+	};
+	const double peak_flops = peak.template operator()<float>("float");
+	if (device.has(sycl::aspect::fp64))
+		peak.template operator()<double>("double");
+	if (device.has(sycl::aspect::fp16))
+		peak.template operator()<sycl::half>("half");
+
+	// the kernels of the examples
+	const gpu::roofline roofline{peak_flops, peak_bytes};
+	{
+		const std::size_t size = 1u << 24;
+		auto in_buffer = sycl::buffer<float, 1>{sycl::range<1>{size}};
+		auto out_buffer = sycl::buffer<float, 1>{sycl::range<1>{size}};
+		const double seconds = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+			handler.parallel_for(sycl::range<1>{size}, gpu::sqrt_kernel<float, 1u>{in_buffer, out_buffer, handler});
+		});
+		roofline.place("sqrt (04-host-access)", size, 8.0 * size, seconds);
+	}
+	{
+		const std::size_t dim = 2048;
+		const sycl::range<2> range{dim, dim};
+		auto m0 = sycl::buffer<float, 2>{range}, m1 = sycl::buffer<float, 2>{range}, m2 = sycl::buffer<float, 2>{range};
+		const double seconds = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+			handler.parallel_for(
+				sycl::nd_range<2>{range, sycl::range<2>{2, 2}},
+				gpu::addition_kernel<float>{m0, m1, m2, sycl::range<3>{2, 2, 3}, handler}
+			);
+		});
+		roofline.place("matrix addition (01)", dim * dim, 12.0 * dim * dim, seconds);
+	}
+	{
+		// every work-item loads a row and a column
+		const std::size_t dim = 256;
+		const sycl::range<2> range{dim, dim};
+		auto m0 = sycl::buffer<float, 2>{range}, m1 = sycl::buffer<float, 2>{range}, m2 = sycl::buffer<float, 2>{range};
+		const double seconds = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+			handler.parallel_for(
+				sycl::nd_range<2>{range, sycl::range<2>{2, 2}},
+				gpu::multiplication_kernel<float>{m0, m1, m2, sycl::range<3>{2, 2, 2 * dim + 1}, handler}
+			);
+		});
+		roofline.place("matrix multiplication (02)", 2.0 * dim * dim * dim, 4.0 * (2.0 * dim * dim * dim + dim * dim), seconds);
+	}
+	{
+		// every work-item loads 2 values per tile step
+		const int dim = 1024;
+		const std::size_t size = std::size_t{dim} * dim;
+		auto * ma = sycl::malloc_device<float>(size, queue);
+		auto * mb = sycl::malloc_device<float>(size, queue);
+		auto * mc = sycl::malloc_device<float>(size, queue);
+		queue.fill(ma, 1.0f, size);
+		queue.fill(mb, 1.0f, size).wait();
+		const double seconds = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+			handler.parallel_for(
+				sycl::nd_range<2>{sycl::range<2>{std::size_t{dim}, std::size_t{dim}}, sycl::range<2>{gpu::tile, gpu::tile}},
+				gpu::gemm_kernel{ma, mb, mc, dim, handler}
+			);
+		});
+		roofline.place("tiled gemm (05)", 2.0 * dim * dim * dim, 4.0 * (2.0 * size * dim / gpu::tile + size), seconds);
+		sycl::free(ma, queue);
+		sycl::free(mb, queue);
+		sycl::free(mc, queue);
+	}
+	{
+		const std::size_t side = 8 * gpu::area_size;
+		const sycl::range<2> range{side, side};
+		auto in_buffer = sycl::buffer<gpu::color_type, 2>{range};
+		auto out_buffer = sycl::buffer<gpu::color_type, 2>{range};
+		const double seconds = gpu::device_seconds(queue, [&] (sycl::handler & handler) {
+			handler.parallel_for(
+				sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+				gpu::image_piece_rotate_kernel{in_buffer, out_buffer, sycl::range<3>{gpu::block_size, gpu::block_size, gpu::lm_offset}, handler}
+			);
+		});
+		roofline.place("image piece rotate (03)", 0, 2.0 * sizeof(gpu::color_type) * side * side, seconds);
+	}
+
+	sycl::free(a, queue);
+	sycl::free(b, queue);
+	sycl::free(c, queue);
+	sycl::free(counters, queue);
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
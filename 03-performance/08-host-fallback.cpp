@@ -0,0 +1,558 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <string>
+#include <optional>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <execution>
+#include <cmath>
+
+using std::string_literals::operator""s;
+
+// Host fallback
+/*
+	gpu::dispatcher runs sqrt (04-host-access), matrix addition
+	(01-matrix-addition), matrix multiplication (02-matrix-multiplication)
+	and piece rotate (03-image-piece-rotate) through one api, on:
+		gpu:	a sycl gpu device
+		cpu:	a sycl cpu device
+		host:	c++17 parallel algorithms (std::execution::par_unseq), no sycl
+		auto:	the first of gpu, cpu, host that can be created
+
+	A program built this way still runs when there is no usable sycl
+	device: "auto" falls back to the host. The sycl runtime library itself
+	is still needed to start the program.
+
+	multiply keeps a row and a column per work-item in local memory,
+	2 * 2 * (2 * dim + 1) values per work-group; when that does not fit the
+	device's local memory, it runs on the host.
+
+	The benchmark compares the host path with the sycl cpu device path.
+*/
+
+// ./prog [auto|gpu|cpu|host]
+
+namespace gpu
+{
+constexpr auto area_size = 256u;
+constexpr auto block_size = 16u;
+constexpr auto lm_offset = 2u;
+
+using color_type = std::array<unsigned char, 3>;
+using clock_type = std::chrono::steady_clock;
+
+enum class backend { automatic, sycl_gpu, sycl_cpu, host };
+
+// 01-basic-sycl/04-host-access
+template <std::floating_point value_type, unsigned int dimensions>
+class sqrt_kernel
+{
+private:
+	sycl::accessor<value_type, dimensions, sycl::access_mode::read> __input;
+	sycl::accessor<value_type, dimensions, sycl::access_mode::write> __output;
+public:
+	sqrt_kernel(
+		sycl::buffer<value_type, dimensions> & in_buffer__,
+		sycl::buffer<value_type, dimensions> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::item<dimensions> item) const
+	{
+		__output[item.get_id()] = sycl::sqrt(__input[item.get_id()]);
+	}
+};
+
+// 02-ex-ex/01-matrix-addition
+template <typename value_type>
+class addition_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+	sycl::local_accessor<value_type, 3> __lm;
+public:
+	addition_kernel(
+		sycl::buffer<value_type, 2> & matrix0__,
+		sycl::buffer<value_type, 2> & matrix1__,
+		sycl::buffer<value_type, 2> & matrix2__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__matrix0{matrix0__, handler__, sycl::read_only},
+		__matrix1{matrix1__, handler__, sycl::read_only},
+		__matrix2{matrix2__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gid_j = item.get_global_id(0);
+		auto gid_i = item.get_global_id(1);
+		auto lid_j = item.get_local_id(0);
+		auto lid_i = item.get_local_id(1);
+
+		value_type & lm0 = __lm[lid_j][lid_i][0];
+		value_type & lm1 = __lm[lid_j][lid_i][1];
+		value_type & lm2 = __lm[lid_j][lid_i][2];
+
+		lm0 = __matrix0[gid_j][gid_i];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		lm1 = __matrix1[gid_j][gid_i];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+		lm2 = lm0 + lm1;
+		__matrix2[gid_j][gid_i] = lm2;
+	}
+};
+
+// 02-ex-ex/02-matrix-multiplication
+template <typename value_type>
+class multiplication_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+	sycl::local_accessor<value_type, 3> __lm;
+public:
+	multiplication_kernel(
+		sycl::buffer<value_type, 2> & m0__,
+		sycl::buffer<value_type, 2> & m1__,
+		sycl::buffer<value_type, 2> & m2__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__matrix0{m0__, handler__, sycl::read_only},
+		__matrix1{m1__, handler__, sycl::read_only},
+		__matrix2{m2__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+		auto gsizex = item.get_global_range()[1];
+
+		for (std::size_t i=0; i<gsizex; ++i)
+			__lm[lidy][lidx][i] = __matrix0[gidy][i];
+		for (std::size_t j=0; j<gsizex; ++j)
+			__lm[lidy][lidx][j+gsizex] = __matrix1[j][gidx];
+
+		value_type & sum = __lm[lidy][lidx][gsizex + gsizex];
+		sum = 0;
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		for (std::size_t i0=0; i0<gsizex; ++i0)
+			sum += __lm[lidy][lidx][i0] * __lm[lidy][lidx][i0 + gsizex];
+
+		__matrix2[gidy][gidx] = sum;
+	}
+};
+
+// 02-ex-ex/03-image-piece-rotate
+class image_piece_rotate_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	sycl::local_accessor<gpu::color_type, 3> __lm;
+public:
+	image_piece_rotate_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto y_start = static_cast<unsigned int>(gidy/gpu::area_size) * gpu::area_size;
+		auto x_start = static_cast<unsigned int>(gidx/gpu::area_size) * gpu::area_size;
+
+		auto src_gidy = gidx - x_start + y_start;
+		auto src_gidx = gidy - y_start + x_start;
+
+		color_type & lm0 = __lm[lidy][lidx][0];
+
+		lm0 = __input[src_gidy][src_gidx];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		__output[gidy][gidx] = lm0;
+	}
+};
+
+// Host versions: parallel over rows, plain contiguous inner loops the
+// compiler can vectorize.
+namespace host
+{
+
+inline std::vector<std::size_t> rows(std::size_t count__)
+{
+	std::vector<std::size_t> rows(count__);
+	std::iota(rows.begin(), rows.end(), 0);
+	return rows;
+}
+
+inline void sqrt(const float * input__, float * output__, std::size_t size__)
+{
+	std::transform(std::execution::par_unseq, input__, input__ + size__, output__, [] (float x) { return std::sqrt(x); });
+}
+
+template <typename value_type>
+void add(const value_type * m0__, const value_type * m1__, value_type * m2__, std::size_t size__)
+{
+	std::transform(std::execution::par_unseq, m0__, m0__ + size__, m1__, m2__, std::plus<value_type>{});
+}
+
+// i-k-j order: the inner loop runs along rows of m1 and m2
+template <typename value_type>
+void multiply(const value_type * m0__, const value_type * m1__, value_type * m2__, std::size_t dim__)
+{
+	const auto rows = gpu::host::rows(dim__);
+	std::for_each(
+		std::execution::par,
+		rows.begin(),
+		rows.end(),
+		[=] (std::size_t y)
+		{
+			value_type * out = m2__ + y * dim__;
+			std::fill(out, out + dim__, value_type{0});
+			for (std::size_t k=0; k<dim__; ++k)
+			{
+				const value_type a = m0__[y * dim__ + k];
+				const value_type * b = m1__ + k * dim__;
+				for (std::size_t x=0; x<dim__; ++x)
+					out[x] += a * b[x];
+			}
+		}
+	);
+}
+
+// One output row of an area is one input column of the same area.
+inline void piece_rotate(const color_type * input__, color_type * output__, std::size_t width__, std::size_t height__)
+{
+	const auto rows = gpu::host::rows(height__);
+	std::for_each(
+		std::execution::par,
+		rows.begin(),
+		rows.end(),
+		[=] (std::size_t y)
+		{
+			const std::size_t y_start = y / gpu::area_size * gpu::area_size;
+			for (std::size_t x_start=0; x_start<width__; x_start+=gpu::area_size)
+			{
+				const color_type * column = input__ + y_start * width__ + (y - y_start + x_start);
+				color_type * out = output__ + y * width__ + x_start;
+				for (std::size_t x=0; x<gpu::area_size; ++x)
+					out[x] = column[x * width__];
+			}
+		}
+	);
+}
+
+}	// namespace host
+
+class dispatcher
+{
+private:
+	std::optional<sycl::queue> __queue;
+	gpu::backend __backend;
+public:
+	dispatcher(gpu::backend backend__ = gpu::backend::automatic):
+		__backend{backend__}
+	{
+		switch (backend__)
+		{
+		case gpu::backend::sycl_gpu:
+			__queue.emplace(sycl::gpu_selector_v);
+			break;
+		case gpu::backend::sycl_cpu:
+			__queue.emplace(sycl::cpu_selector_v);
+			break;
+		case gpu::backend::host:
+			break;
+		case gpu::backend::automatic:
+			for (auto backend: {gpu::backend::sycl_gpu, gpu::backend::sycl_cpu})
+			{
+				try
+				{
+					if (backend == gpu::backend::sycl_gpu)
+						__queue.emplace(sycl::gpu_selector_v);
+					else
+						__queue.emplace(sycl::cpu_selector_v);
+					__backend = backend;
+					return;
+				}
+				catch (const sycl::exception & e)
+				{
+					std::cerr << "no " << (backend == gpu::backend::sycl_gpu ? "gpu" : "cpu") << " device: " << e.what() << std::endl;
+				}
+			}
+			__backend = gpu::backend::host;
+			break;
+		}
+	}
+public:
+	gpu::backend backend() const
+	{
+		return __backend;
+	}
+	std::string name() const
+	{
+		if (! __queue)
+			return "host";
+		return (__backend == gpu::backend::sycl_gpu ? "sycl gpu: "s : "sycl cpu: "s) +
+			__queue->get_device().get_info<sycl::info::device::name>();
+	}
+	void sqrt(const float * input__, float * output__, std::size_t size__)
+	{
+		if (! __queue)
+			return gpu::host::sqrt(input__, output__, size__);
+
+		const sycl::range<1> range{size__};
+		auto in_buffer = sycl::buffer<float, 1>{input__, range};
+		auto out_buffer = sycl::buffer<float, 1>{output__, range};
+		__queue->submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(range, gpu::sqrt_kernel<float, 1u>{in_buffer, out_buffer, handler});
+			}
+		);
+	}
+	// rows__ and cols__ are even
+	template <typename value_type>
+	void add(const value_type * m0__, const value_type * m1__, value_type * m2__, std::size_t rows__, std::size_t cols__)
+	{
+		if (! __queue)
+			return gpu::host::add(m0__, m1__, m2__, rows__ * cols__);
+
+		const sycl::range<2> range{rows__, cols__};
+		auto m0_buff = sycl::buffer<value_type, 2>{m0__, range};
+		auto m1_buff = sycl::buffer<value_type, 2>{m1__, range};
+		auto m2_buff = sycl::buffer<value_type, 2>{m2__, range};
+		__queue->submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::nd_range<2>{range, sycl::range<2>{2, 2}},
+					gpu::addition_kernel<value_type>{m0_buff, m1_buff, m2_buff, sycl::range<3>{2, 2, 3}, handler}
+				);
+			}
+		);
+	}
+	// dim__ is even
+	template <typename value_type>
+	void multiply(const value_type * m0__, const value_type * m1__, value_type * m2__, std::size_t dim__)
+	{
+		const std::size_t lm_bytes = 2 * 2 * (2 * dim__ + 1) * sizeof(value_type);
+		if (! __queue || lm_bytes > __queue->get_device().get_info<sycl::info::device::local_mem_size>())
+			return gpu::host::multiply(m0__, m1__, m2__, dim__);
+
+		const sycl::range<2> range{dim__, dim__};
+		auto m0_buff = sycl::buffer<value_type, 2>{m0__, range};
+		auto m1_buff = sycl::buffer<value_type, 2>{m1__, range};
+		auto m2_buff = sycl::buffer<value_type, 2>{m2__, range};
+		__queue->submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::nd_range<2>{range, sycl::range<2>{2, 2}},
+					gpu::multiplication_kernel<value_type>{m0_buff, m1_buff, m2_buff, sycl::range<3>{2, 2, 2 * dim__ + 1}, handler}
+				);
+			}
+		);
+	}
+	// width__ and height__ are N * area_size
+	void piece_rotate(const color_type * input__, color_type * output__, std::size_t width__, std::size_t height__)
+	{
+		if (! __queue)
+			return gpu::host::piece_rotate(input__, output__, width__, height__);
+
+		const sycl::range<2> range{height__, width__};
+		auto in_buffer = sycl::buffer<gpu::color_type, 2>{input__, range};
+		auto out_buffer = sycl::buffer<gpu::color_type, 2>{output__, range};
+		__queue->submit(
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+					gpu::image_piece_rotate_kernel{in_buffer, out_buffer, sycl::range<3>{gpu::block_size, gpu::block_size, gpu::lm_offset}, handler}
+				);
+			}
+		);
+	}
+};
+
+// mean milliseconds of 5 calls, after one warm up call
+template <typename function_type>
+double measure_ms(function_type && function__)
+{
+	function__();
+	auto start = gpu::clock_type::now();
+	for (int i=0; i<5; ++i)
+		function__();
+	return std::chrono::duration<double, std::milli>(gpu::clock_type::now() - start).count() / 5;
+}
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string backend_name = argc > 1 ? argv[1] : "auto";
+	const gpu::backend backend =
+		backend_name == "auto" ? gpu::backend::automatic :
+		backend_name == "gpu" ? gpu::backend::sycl_gpu :
+		backend_name == "cpu" ? gpu::backend::sycl_cpu :
+		backend_name == "host" ? gpu::backend::host :
+		throw std::runtime_error{""s + argv[0] + " [auto|gpu|cpu|host]"};
+
+	gpu::dispatcher selected{backend};
+	std::cout << "selected: " << selected.name() << std::endl;
+
+	// the output of 02-matrix-multiplication, on the selected backend
+	{
+		const std::vector<int> m0{1,2,3,4, 3,2,-1,-2, -2,2,3,2, 4,2,-3,4};
+		const std::vector<int> m1{2,1,-2,-3, 3,2,4,5, 2,-2,3,4, -2,-3,-3,-4};
+		std::vector<int> m2(16);
+		selected.multiply(m0.data(), m1.data(), m2.data(), 4);
+		for (int j=0; j<4; ++j)
+		{
+			for (int i=0; i<4; ++i)
+				std::cout << std::setw(5) << m2[j * 4 + i];
+			std::cout << std::endl;
+		}
+		std::cout << std::endl;
+	}
+
+	// host vs the sycl cpu device
+	gpu::dispatcher host{gpu::backend::host};
+	std::optional<gpu::dispatcher> cpu;
+	try
+	{
+		cpu.emplace(gpu::backend::sycl_cpu);
+	}
+	catch (const sycl::exception & e)
+	{
+		std::cout << "no sycl cpu device, only the host runs: " << e.what() << std::endl;
+	}
+
+	std::cout << std::setw(28) << std::left << "" << std::right
+		<< std::setw(12) << "host ms"
+		<< std::setw(14) << "sycl cpu ms" << std::endl;
+	auto compare = [&] (const std::string & name__, auto && run__, auto && equal__)
+	{
+		const double host_ms = gpu::measure_ms([&] { run__(host, 0); });
+		std::cout << std::setw(28) << std::left << name__ << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(12) << host_ms;
+		if (cpu)
+		{
+			const double cpu_ms = gpu::measure_ms([&] { run__(*cpu, 1); });
+			std::cout << std::setw(14) << cpu_ms << (equal__() ? "" : "  DIFFERENT RESULTS");
+		}
+		std::cout << std::endl;
+	};
+
+	{
+		const std::size_t size = 1u << 24;
+		std::vector<float> input(size);
+		std::iota(input.begin(), input.end(), 0.0f);
+		std::array<std::vector<float>, 2> output{std::vector<float>(size), std::vector<float>(size)};
+		compare(
+			"sqrt 16M",
+			[&] (gpu::dispatcher & d__, int i__) { d__.sqrt(input.data(), output[i__].data(), size); },
+			[&] {
+				for (std::size_t i=0; i<size; ++i)
+					if (std::abs(output[0][i] - output[1][i]) > 1e-6f * output[0][i])
+						return false;
+				return true;
+			}
+		);
+	}
+	{
+		const std::size_t dim = 2048;
+		std::vector<float> m0(dim * dim), m1(dim * dim);
+		std::iota(m0.begin(), m0.end(), 0.0f);
+		std::iota(m1.begin(), m1.end(), 1.0f);
+		std::array<std::vector<float>, 2> m2{std::vector<float>(dim * dim), std::vector<float>(dim * dim)};
+		compare(
+			"matrix addition 2048x2048",
+			[&] (gpu::dispatcher & d__, int i__) { d__.add(m0.data(), m1.data(), m2[i__].data(), dim, dim); },
+			[&] { return m2[0] == m2[1]; }
+		);
+	}
+	{
+		const std::size_t dim = 256;
+		std::vector<int> m0(dim * dim), m1(dim * dim);
+		for (std::size_t i=0; i<m0.size(); ++i)
+		{
+			m0[i] = static_cast<int>(i % 7) - 3;
+			m1[i] = static_cast<int>(i % 5) - 2;
+		}
+		std::array<std::vector<int>, 2> m2{std::vector<int>(dim * dim), std::vector<int>(dim * dim)};
+		compare(
+			"matrix multiplication 256",
+			[&] (gpu::dispatcher & d__, int i__) { d__.multiply(m0.data(), m1.data(), m2[i__].data(), dim); },
+			[&] { return m2[0] == m2[1]; }
+		);
+	}
+	{
+		const std::size_t width = 8 * gpu::area_size, height = 6 * gpu::area_size;
+		std::vector<gpu::color_type> image(width * height);
+		for (std::size_t i=0; i<image.size(); ++i)
+			image[i] = {static_cast<unsigned char>(i), static_cast<unsigned char>(i >> 8), static_cast<unsigned char>(i >> 16)};
+		std::array<std::vector<gpu::color_type>, 2> output{std::vector<gpu::color_type>(image.size()), std::vector<gpu::color_type>(image.size())};
+		compare(
+			"piece rotate 2048x1536",
+			[&] (gpu::dispatcher & d__, int i__) { d__.piece_rotate(image.data(), output[i__].data(), width, height); },
+			[&] { return output[0] == output[1]; }
+		);
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
+
+// output (the first lines):
+/*
+selected: ...
+    6  -13    3    3
+   14   15    5    5
+    4  -10   15   20
+    0    2  -21  -30
+
+*/
@@ -0,0 +1,293 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <string>
+#include <limits>
+#include <algorithm>
+
+using std::string_literals::operator""s;
+
+// Piece rotate, thread coarsening
+/*
+	image_piece_rotate_kernel of 02-ex-ex/03-image-piece-rotate runs one
+	work-item per pixel in 16 x 16 groups, one barrier per 256 pixels, and
+	works out y_start/x_start for every pixel.
+
+	coarsened_piece_rotate_kernel<coarsen_y, coarsen_x>:
+		+ a work-group rotates a tile of (16 * coarsen_y) x (16 * coarsen_x)
+		  pixels, each work-item coarsen_y * coarsen_x of them
+		+ the tile lies inside one area, so y_start/x_start and the source
+		  corner are worked out once per work-item
+		+ the work-group copies the source tile to local memory with reads
+		  along the source rows, then one barrier, then writes along the
+		  output rows from local memory: both sides are contiguous
+
+	The sweep runs all coarsening factors that fit in local memory and
+	checks each against the original kernel. Device times from event
+	profiling, best of 5.
+*/
+
+// ./prog [cpu|gpu] [areas per side]
+
+namespace gpu
+{
+constexpr auto area_size = 256u;
+constexpr auto block_size = 16u;
+constexpr auto lm_offset = 2u;
+constexpr int runs = 5;
+
+using color_type = std::array<unsigned char, 3>;
+
+// 02-ex-ex/03-image-piece-rotate
+class image_piece_rotate_kernel
+{
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	sycl::local_accessor<gpu::color_type, 3> __lm;
+public:
+	image_piece_rotate_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		const sycl::range<3> & lm_range__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__lm{lm_range__, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		auto lidy = item.get_local_id(0);
+		auto lidx = item.get_local_id(1);
+
+		auto y_start = static_cast<unsigned int>(gidy/gpu::area_size) * gpu::area_size;
+		auto x_start = static_cast<unsigned int>(gidx/gpu::area_size) * gpu::area_size;
+
+		auto src_gidy = gidx - x_start + y_start;
+		auto src_gidx = gidy - y_start + x_start;
+
+		color_type & lm0 = __lm[lidy][lidx][0];
+
+		lm0 = __input[src_gidy][src_gidx];
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		__output[gidy][gidx] = lm0;
+	}
+};
+
+template <unsigned int coarsen_y, unsigned int coarsen_x>
+class coarsened_piece_rotate_kernel
+{
+public:
+	constexpr static unsigned int tile_height = gpu::block_size * coarsen_y;
+	constexpr static unsigned int tile_width = gpu::block_size * coarsen_x;
+	static_assert(gpu::area_size % tile_height == 0 && gpu::area_size % tile_width == 0);
+
+	// the source tile: tile_width rows, tile_height columns
+	constexpr static std::size_t lm_bytes = sizeof(gpu::color_type) * tile_width * tile_height;
+private:
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::read> __input;
+	sycl::accessor<gpu::color_type, 2, sycl::access_mode::write> __output;
+	sycl::local_accessor<gpu::color_type, 2> __lm;
+public:
+	coarsened_piece_rotate_kernel(
+		sycl::buffer<gpu::color_type, 2> & in_buffer__,
+		sycl::buffer<gpu::color_type, 2> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only},
+		__lm{sycl::range<2>{tile_width, tile_height}, handler__}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		const unsigned int lidy = item.get_local_id(0);
+		const unsigned int lidx = item.get_local_id(1);
+
+		// once per work-item: the tile, its area, the source corner
+		const unsigned int tile_y = item.get_group(0) * tile_height;
+		const unsigned int tile_x = item.get_group(1) * tile_width;
+		const unsigned int y_start = tile_y / gpu::area_size * gpu::area_size;
+		const unsigned int x_start = tile_x / gpu::area_size * gpu::area_size;
+		const unsigned int src_y = tile_x - x_start + y_start;
+		const unsigned int src_x = tile_y - y_start + x_start;
+
+		#pragma unroll
+		for (unsigned int i=0; i<coarsen_x; ++i)
+		{
+			const unsigned int r = lidy + i * gpu::block_size;
+			#pragma unroll
+			for (unsigned int j=0; j<coarsen_y; ++j)
+			{
+				const unsigned int c = lidx + j * gpu::block_size;
+				__lm[r][c] = __input[src_y + r][src_x + c];
+			}
+		}
+		sycl::group_barrier(item.get_group(), sycl::memory_scope::work_group);
+
+		#pragma unroll
+		for (unsigned int i=0; i<coarsen_y; ++i)
+		{
+			const unsigned int oy = lidy + i * gpu::block_size;
+			#pragma unroll
+			for (unsigned int j=0; j<coarsen_x; ++j)
+			{
+				const unsigned int ox = lidx + j * gpu::block_size;
+				__output[tile_y + oy][tile_x + ox] = __lm[ox][oy];
+			}
+		}
+	}
+};
+
+// Best device time of gpu::runs launches, in milliseconds, after one warm up.
+template <typename cgf_type>
+double device_ms(sycl::queue & queue__, cgf_type && cgf__)
+{
+	queue__.submit(cgf__).wait();
+	double best = std::numeric_limits<double>::max();
+	for (int i=0; i<gpu::runs; ++i)
+	{
+		auto event = queue__.submit(cgf__);
+		event.wait();
+		const auto start = event.template get_profiling_info<sycl::info::event_profiling::command_start>();
+		const auto end = event.template get_profiling_info<sycl::info::event_profiling::command_end>();
+		best = std::min(best, (end - start) * 1e-6);
+	}
+	return best;
+}
+
+class sweep
+{
+private:
+	sycl::queue & __queue;
+	sycl::buffer<gpu::color_type, 2> & __input;
+	sycl::buffer<gpu::color_type, 2> & __expected;
+	std::size_t __pixels;
+	double __baseline_ms;
+public:
+	sweep(sycl::queue & queue__, sycl::buffer<gpu::color_type, 2> & input__, sycl::buffer<gpu::color_type, 2> & expected__):
+		__queue{queue__},
+		__input{input__},
+		__expected{expected__},
+		__pixels{input__.get_range().size()}
+	{
+		const auto range = __input.get_range();
+		__baseline_ms = gpu::device_ms(
+			__queue,
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::nd_range<2>{range, sycl::range<2>{gpu::block_size, gpu::block_size}},
+					gpu::image_piece_rotate_kernel{__input, __expected, sycl::range<3>{gpu::block_size, gpu::block_size, gpu::lm_offset}, handler}
+				);
+			}
+		);
+		std::cout << std::setw(12) << "coarsening" << std::setw(12) << "tile"
+			<< std::setw(12) << "ms" << std::setw(14) << "Mpixel/s" << std::setw(10) << "speedup" << "\n";
+		this->print("original", gpu::block_size, gpu::block_size, __baseline_ms);
+	}
+public:
+	template <unsigned int coarsen_y, unsigned int coarsen_x>
+	void run()
+	{
+		using kernel_type = gpu::coarsened_piece_rotate_kernel<coarsen_y, coarsen_x>;
+		const std::string name = std::to_string(coarsen_y) + "x" + std::to_string(coarsen_x);
+		if (kernel_type::lm_bytes > __queue.get_device().template get_info<sycl::info::device::local_mem_size>())
+		{
+			std::cout << std::setw(12) << name << "  local memory too small" << std::endl;
+			return;
+		}
+
+		const auto range = __input.get_range();
+		sycl::buffer<gpu::color_type, 2> output{range};
+		const double ms = gpu::device_ms(
+			__queue,
+			[&] (sycl::handler & handler)
+			{
+				handler.parallel_for(
+					sycl::nd_range<2>{
+						sycl::range<2>{range[0] / coarsen_y, range[1] / coarsen_x},
+						sycl::range<2>{gpu::block_size, gpu::block_size}
+					},
+					kernel_type{__input, output, handler}
+				);
+			}
+		);
+		this->print(name, kernel_type::tile_height, kernel_type::tile_width, ms);
+
+		auto result = output.get_host_access();
+		auto expected = __expected.get_host_access();
+		if (! std::equal(result.begin(), result.end(), expected.begin()))
+			throw std::runtime_error{"coarsening " + name + ": wrong result"};
+	}
+private:
+	void print(const std::string & name__, unsigned int tile_height__, unsigned int tile_width__, double ms__) const
+	{
+		std::cout << std::setw(12) << name__
+			<< std::setw(12) << std::to_string(tile_height__) + "x" + std::to_string(tile_width__)
+			<< std::fixed << std::setprecision(3)
+			<< std::setw(12) << ms__
+			<< std::setw(14) << std::setprecision(1) << __pixels / ms__ * 1e-3
+			<< std::setw(9) << std::setprecision(2) << __baseline_ms / ms__ << "x" << std::endl;
+	}
+};
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "cpu";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [cpu|gpu] [areas per side]"};
+	const unsigned int areas = argc > 2 ? std::stoul(argv[2]) : 16;
+
+	const sycl::property_list props{sycl::property::queue::enable_profiling{}};
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v, props} :
+		sycl::queue{sycl::gpu_selector_v, props};
+	std::cout << queue.get_device().get_info<sycl::info::device::name>() << "\n";
+
+	const std::size_t side = std::size_t{areas} * gpu::area_size;
+	std::cout << "image: " << side << " x " << side << "\n\n";
+	std::vector<gpu::color_type> image(side * side);
+	for (std::size_t i=0; i<image.size(); ++i)
+		image[i] = {static_cast<unsigned char>(i), static_cast<unsigned char>(i >> 8), static_cast<unsigned char>(i >> 16)};
+
+	auto input = sycl::buffer<gpu::color_type, 2>{image.data(), sycl::range<2>{side, side}};
+	auto expected = sycl::buffer<gpu::color_type, 2>{sycl::range<2>{side, side}};
+
+	gpu::sweep sweep{queue, input, expected};
+	sweep.run<1, 1>();
+	sweep.run<1, 2>();
+	sweep.run<2, 1>();
+	sweep.run<2, 2>();
+	sweep.run<2, 4>();
+	sweep.run<4, 4>();
+	sweep.run<4, 8>();
+	sweep.run<8, 8>();
+	sweep.run<8, 16>();
+	sweep.run<16, 16>();
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
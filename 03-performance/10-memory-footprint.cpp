@@ -0,0 +1,249 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "memory_trace.hpp"
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <numeric>
+#include <memory>
+#include <string>
+
+using std::string_literals::operator""s;
+
+// Memory footprint and buffer lifetimes
+/*
+	The allocation patterns of the examples, through gpu::memory::tracker:
+		+ 01-basic-sycl/03-sycl-buffer: new sycl::buffer ... delete, the
+		  buffers stay alive until the end of main
+		+ a result read on the host after every kernel: the buffer goes
+		  back and forth between host and device
+		+ usm: malloc_device, memcpy in, kernel, memcpy out, free at the end
+
+	The summary lists every allocation, the implicit copies, the peak
+	resident bytes, and where a buffer could be released earlier or
+	reused. The timeline shows resident bytes and lifetimes.
+
+	10-memory-footprint is built with HAPPY_MEMORY_TRACE, 10-memory-footprint-off
+	is the same source without it.
+*/
+
+// ./prog [gpu|cpu] [memory.json]
+// Open memory.json in chrome://tracing or https://ui.perfetto.dev
+
+namespace gpu
+{
+
+template <std::floating_point value_type, unsigned int dimensions>
+class sqrt_kernel
+{
+private:
+	sycl::accessor<value_type, dimensions, sycl::access_mode::read> __input;
+	sycl::accessor<value_type, dimensions, sycl::access_mode::write> __output;
+public:
+	sqrt_kernel(
+		sycl::buffer<value_type, dimensions> & in_buffer__,
+		sycl::buffer<value_type, dimensions> & out_buffer__,
+		sycl::handler & handler__
+	):
+		__input{in_buffer__, handler__, sycl::read_only},
+		__output{out_buffer__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::item<dimensions> item) const
+	{
+		__output[item.get_id()] = sycl::sqrt(__input[item.get_id()]);
+	}
+};
+
+template <typename value_type>
+class addition_kernel
+{
+private:
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix0;
+	sycl::accessor<value_type, 2, sycl::access_mode::read> __matrix1;
+	sycl::accessor<value_type, 2, sycl::access_mode::write> __matrix2;
+public:
+	addition_kernel(
+		sycl::buffer<value_type, 2> & matrix0__,
+		sycl::buffer<value_type, 2> & matrix1__,
+		sycl::buffer<value_type, 2> & matrix2__,
+		sycl::handler & handler__
+	):
+		__matrix0{matrix0__, handler__, sycl::read_only},
+		__matrix1{matrix1__, handler__, sycl::read_only},
+		__matrix2{matrix2__, handler__, sycl::write_only}
+	{
+	}
+public:
+	void operator()(sycl::nd_item<2> item) const
+	{
+		auto gidy = item.get_global_id(0);
+		auto gidx = item.get_global_id(1);
+		__matrix2[gidy][gidx] = __matrix0[gidy][gidx] + __matrix1[gidy][gidx];
+	}
+};
+
+template <std::floating_point value_type>
+class usm_sqrt_kernel
+{
+private:
+	const value_type * __input;
+	value_type * __output;
+public:
+	usm_sqrt_kernel(const value_type * input__, value_type * output__):
+		__input{input__},
+		__output{output__}
+	{
+	}
+public:
+	void operator()(sycl::id<1> id) const
+	{
+		__output[id] = sycl::sqrt(__input[id]);
+	}
+};
+
+}	// namespace gpu
+
+int main(int argc, char * argv[])
+try
+{
+	const std::string device_name = argc > 1 ? argv[1] : "gpu";
+	const std::string timeline_file = argc > 2 ? argv[2] : "memory.json";
+	if (device_name != "gpu" && device_name != "cpu")
+		throw std::runtime_error{""s + argv[0] + " [gpu|cpu] [memory.json]"};
+
+	sycl::queue queue = device_name == "cpu" ?
+		sycl::queue{sycl::cpu_selector_v} :
+		sycl::queue{sycl::gpu_selector_v};
+	std::cout << queue.get_device().get_info<sycl::info::device::name>() << "\n\n";
+
+	gpu::memory::tracker tracker;
+
+	constexpr auto size = 1u << 20;
+	constexpr auto dimy = 1024u, dimx = 1024u, ldimy = 16u, ldimx = 16u;
+	using value_type = float;
+	using buffer_1d = gpu::memory::tracked_buffer<value_type, 1>;
+	using buffer_2d = gpu::memory::tracked_buffer<value_type, 2>;
+
+	std::vector<value_type> input(size);
+	std::iota(input.begin(), input.end(), 1.0f);
+
+	// 01-basic-sycl/03-sycl-buffer: new/delete at the end of main. Every
+	// buffer made from host data owns its own vector until it is destroyed.
+	std::vector<value_type> sqrt_input(input);
+	auto * in_buffer = new buffer_1d{tracker, "in_buffer", sqrt_input.data(), sycl::range<1>{size}};
+	auto * out_buffer = new buffer_1d{tracker, "out_buffer", sycl::range<1>{size}};
+	tracker.submit(
+		queue,
+		"sqrt_kernel",
+		{tracker.read(*in_buffer), tracker.write(*out_buffer)},
+		[&] (sycl::handler & handler)
+		{
+			gpu::sqrt_kernel<value_type, 1u> kernel{in_buffer->get(), out_buffer->get(), handler};
+			handler.parallel_for<class kn1>(sycl::range<1>{size}, kernel);
+		}
+	);
+	{
+		auto host_access = tracker.host_access(*out_buffer, "print sqrt", sycl::read_only);
+		std::cout << "sqrt: " << host_access[0] << " " << host_access[1] << " " << host_access[2] << std::endl;
+	}
+
+	// in_buffer and out_buffer are idle from here on
+	{
+		std::vector<value_type> matrix0(input), matrix1(input);
+		buffer_2d m0_buff{tracker, "m0_buff", matrix0.data(), sycl::range<2>{dimy, dimx}};
+		buffer_2d m1_buff{tracker, "m1_buff", matrix1.data(), sycl::range<2>{dimy, dimx}};
+		buffer_2d m2_buff{tracker, "m2_buff", sycl::range<2>{dimy, dimx}};
+		const sycl::nd_range<2> range{sycl::range<2>{dimy, dimx}, sycl::range<2>{ldimy, ldimx}};
+
+		// the host looks at the result after every step
+		for (int i=0; i<3; ++i)
+		{
+			tracker.submit(
+				queue,
+				"addition_kernel",
+				{tracker.read(m0_buff), tracker.read(m1_buff), tracker.write(m2_buff)},
+				[&] (sycl::handler & handler)
+				{
+					auto kernel = gpu::addition_kernel{m0_buff.get(), m1_buff.get(), m2_buff.get(), handler};
+					handler.parallel_for<class name1>(range, kernel);
+				}
+			);
+			tracker.submit(
+				queue,
+				"accumulate",
+				{tracker.read(m2_buff), tracker.read(m1_buff), tracker.write(m0_buff)},
+				[&] (sycl::handler & handler)
+				{
+					auto kernel = gpu::addition_kernel{m2_buff.get(), m1_buff.get(), m0_buff.get(), handler};
+					handler.parallel_for<class name2>(range, kernel);
+				}
+			);
+			auto host_access = tracker.host_access(m0_buff, "print addition", sycl::read_only);
+			std::cout << "addition " << i << ": " << host_access[0][0] << " " << host_access[0][1] << " " << host_access[0][2] << std::endl;
+		}
+	}
+
+	// usm: explicit copies, free at the end
+	value_type * usm_input = tracker.malloc_device<value_type>(size, queue, "usm_input");
+	value_type * usm_output = tracker.malloc_device<value_type>(size, queue, "usm_output");
+	if (usm_input == nullptr || usm_output == nullptr)
+		throw std::runtime_error{"malloc_device failed"};
+	tracker.memcpy(queue, usm_input, input.data(), size * sizeof(value_type), "memcpy in").wait();
+	tracker.submit(
+		queue,
+		"usm_sqrt_kernel",
+		{tracker.read(usm_input), tracker.write(usm_output)},
+		[&] (sycl::handler & handler)
+		{
+			handler.parallel_for<class kn2>(sycl::range<1>{size}, gpu::usm_sqrt_kernel<value_type>{usm_input, usm_output});
+		}
+	).wait();
+
+	// usm_input is no longer needed, usm_scratch is the same size
+	value_type * usm_scratch = tracker.malloc_device<value_type>(size, queue, "usm_scratch");
+	if (usm_scratch == nullptr)
+		throw std::runtime_error{"malloc_device failed"};
+	tracker.submit(
+		queue,
+		"usm_sqrt_kernel",
+		{tracker.read(usm_output), tracker.write(usm_scratch)},
+		[&] (sycl::handler & handler)
+		{
+			handler.parallel_for<class kn3>(sycl::range<1>{size}, gpu::usm_sqrt_kernel<value_type>{usm_output, usm_scratch});
+		}
+	).wait();
+	std::vector<value_type> output(size);
+	tracker.memcpy(queue, output.data(), usm_scratch, size * sizeof(value_type), "memcpy out").wait();
+	std::cout << "usm: " << output[0] << " " << output[15] << " " << output[255] << "\n" << std::endl;
+
+	tracker.free(usm_scratch, queue);
+	tracker.free(usm_output, queue);
+	tracker.free(usm_input, queue);
+	delete out_buffer;
+	delete in_buffer;
+
+	tracker.write_summary(std::cout);
+
+	if (gpu::memory::tracker::enabled)
+	{
+		std::ofstream out{timeline_file};
+		if (! out)
+			throw std::runtime_error{"Can not write timeline file: "s + timeline_file};
+		tracker.write_timeline(out);
+		std::cout << std::endl << "Timeline: " << timeline_file << std::endl;
+	}
+}
+catch (const std::exception & e)
+{
+	std::cerr << "--------------------------------------------------------------------------------\n";
+	std::cerr << "std::exception:\n";
+	std::cerr << e.what() << std::endl;
+}
@@ -0,0 +1,161 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <typeinfo>
+#include <stdexcept>
+#include <cctype>
+#include <cstdlib>
+
+// gpu::bundle
+/*
+	Builds the kernels of a program before the first queue.submit, so the
+	first result does not wait for the jit compiler.
+
+		+ gpu::bundle::cache_key: device name, vendor, driver version and
+		  backend version of a device, the directory of its cache entries
+		+ gpu::bundle::cache: one directory per key under a root directory,
+		  a manifest file with the kernels built there before
+		+ cache.warm_up<kernel_types...>(queue): input bundle -> compile -> link
+		  (or the executable bundle, if the kernels are ahead-of-time compiled)
+		+ cache.use(handler): run a command group with the built bundle
+
+	sycl 2020 cannot write an executable kernel_bundle to a file, so the
+	binaries are written by the sycl implementation: the cache points the
+	persistent caches of dpc++ (SYCL_CACHE_DIR) and AdaptiveCpp
+	(ACPP_APPDB_DIR) at its directory. It must be created before the first
+	kernel is built.
+*/
+
+namespace gpu::bundle
+{
+
+using clock_type = std::chrono::steady_clock;
+
+// Readable and file name safe: "<device>-<hash of device, vendor, driver, backend version>"
+inline std::string cache_key(const sycl::device & device__)
+{
+	const std::string name = device__.get_info<sycl::info::device::name>();
+	const std::string full = name + "|" +
+		device__.get_info<sycl::info::device::vendor>() + "|" +
+		device__.get_info<sycl::info::device::driver_version>() + "|" +
+		device__.get_info<sycl::info::device::version>();
+
+	std::string key;
+	for (char c: name)
+	{
+		if (std::isalnum(static_cast<unsigned char>(c)))
+			key += c;
+		else if (! key.empty() && key.back() != '_')
+			key += '_';
+		if (key.size() == 32)
+			break;
+	}
+	std::ostringstream hash;
+	hash << std::hex << std::setw(16) << std::setfill('0') << std::hash<std::string>{}(full);
+	return key + "-" + hash.str();
+}
+
+class cache
+{
+private:
+	sycl::device __device;
+	std::filesystem::path __directory;
+	std::vector<std::string> __manifest;	// kernels built in __directory before
+	std::optional<sycl::kernel_bundle<sycl::bundle_state::executable>> __bundle;
+	double __build_ms = 0;
+public:
+	// root__: HAPPY_BUNDLE_CACHE or ./happy-bundle-cache if empty
+	cache(const sycl::device & device__, std::filesystem::path root__ = {}):
+		__device{device__}
+	{
+		if (root__.empty())
+		{
+			const char * env = std::getenv("HAPPY_BUNDLE_CACHE");
+			root__ = env ? env : "happy-bundle-cache";
+		}
+		__directory = root__ / gpu::bundle::cache_key(__device);
+		std::filesystem::create_directories(__directory);
+
+		const std::string directory = std::filesystem::absolute(__directory).string();
+		::setenv("SYCL_CACHE_PERSISTENT", "1", 1);
+		::setenv("SYCL_CACHE_DIR", directory.c_str(), 1);
+		::setenv("ACPP_APPDB_DIR", directory.c_str(), 1);
+
+		std::ifstream manifest{__directory / "manifest"};
+		for (std::string line; std::getline(manifest, line); )
+			if (! line.empty())
+				__manifest.push_back(line);
+	}
+public:
+	const std::filesystem::path & directory() const
+	{
+		return __directory;
+	}
+	// Were kernels of this program built for this device and driver before?
+	bool warm() const
+	{
+		return ! __manifest.empty();
+	}
+	double build_ms() const
+	{
+		return __build_ms;
+	}
+	// Builds all kernel_types__ for the device of queue__, in one executable bundle.
+	template <typename ... kernel_types__>
+	void warm_up(sycl::queue & queue__)
+	{
+		if (queue__.get_device() != __device)
+			throw std::invalid_argument{"gpu::bundle::cache::warm_up: the queue has another device"};
+		auto start = clock_type::now();
+
+		const std::vector<sycl::kernel_id> ids{sycl::get_kernel_id<kernel_types__>()...};
+		const auto context = queue__.get_context();
+		if (sycl::has_kernel_bundle<sycl::bundle_state::input>(context, {__device}, ids))
+		{
+			auto input = sycl::get_kernel_bundle<sycl::bundle_state::input>(context, {__device}, ids);
+			__bundle = sycl::link(sycl::compile(input));
+		}
+		else
+		{
+			// ahead-of-time compiled: the device image is executable already
+			__bundle = sycl::get_kernel_bundle<sycl::bundle_state::executable>(context, {__device}, ids);
+		}
+		__build_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+		std::ofstream manifest{__directory / "manifest"};
+		const std::vector<std::string> names{typeid(kernel_types__).name()...};
+		for (const auto & name: names)
+			manifest << name << "\n";
+	}
+	// Inside a command group: launch the kernels from the warmed up bundle.
+	void use(sycl::handler & handler__) const
+	{
+		if (__bundle)
+			handler__.use_kernel_bundle(*__bundle);
+	}
+	void clear()
+	{
+		std::filesystem::remove_all(__directory);
+		std::filesystem::create_directories(__directory);
+		__manifest.clear();
+	}
+};
+
+}	// namespace gpu::bundle
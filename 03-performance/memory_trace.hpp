@@ -0,0 +1,522 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "trace.hpp"
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <map>
+#include <string>
+#include <chrono>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <initializer_list>
+#include <optional>
+
+// gpu::memory
+/*
+	Wraps the allocations of a program and records what memory it holds:
+		+ gpu::memory::tracked_buffer: a sycl::buffer with a name
+		+ tracker.malloc_device / malloc_shared / malloc_host / free: usm
+		+ tracker.submit(queue, name, {tracker.read(x), tracker.write(y)}, cgf):
+		  the allocations a command group reads and writes;
+		  tracker.write(y, sycl::no_init) for an accessor with no_init
+		+ tracker.host_access(buffer, name): a host accessor
+		+ tracker.memcpy: explicit usm copies
+
+	From that it keeps, for every allocation: size, allocation, first use,
+	last use and release time, and the implicit host <-> device copies of
+	buffers (first device use of host data, host access after a device
+	write, write back at destruction). A write without no_init keeps the
+	old contents, so it implies the copy as much as a read does. It also
+	keeps the resident device and host bytes over time, and their peaks.
+
+	Shared usm counts as device memory only, also when the host uses it;
+	its page migrations are counted as implicit copies when the host and
+	the device take turns.
+
+	write_summary: allocations, copies, peaks, and suggestions:
+		+ release earlier: idle (after its last use) at the device peak
+		+ reuse: same size, and alive only after the other one's last use
+	write_timeline: chrome trace json (chrome://tracing, ui.perfetto.dev),
+	resident bytes as counters, one lifetime span per allocation.
+
+	Define HAPPY_MEMORY_TRACE to enable it. Without it, the tracker records
+	nothing and the wrappers only forward.
+*/
+
+namespace gpu::memory
+{
+
+#ifdef HAPPY_MEMORY_TRACE
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+using clock_type = std::chrono::steady_clock;
+
+enum class kind_type { buffer, usm_device, usm_shared, usm_host };
+
+// What a command group or the host does with an allocation.
+class use_type
+{
+public:
+	std::size_t id;
+	bool read, write;
+	bool no_init = false;	// old contents discarded
+};
+
+class tracker;
+
+// A sycl::buffer whose lifetime the tracker sees.
+template <typename value_type, int dimensions>
+class tracked_buffer
+{
+private:
+	gpu::memory::tracker & __tracker;
+	std::size_t __id;
+	// reset in the destructor before the release is recorded: the blocking
+	// destruction and the write back belong to the lifetime
+	std::optional<sycl::buffer<value_type, dimensions>> __buffer;
+public:
+	tracked_buffer(const tracked_buffer &) = delete;
+	tracked_buffer & operator=(const tracked_buffer &) = delete;
+	// device data, no host copy
+	tracked_buffer(gpu::memory::tracker & tracker__, const std::string & name__, const sycl::range<dimensions> & range__);
+	// host data, written back at destruction
+	tracked_buffer(gpu::memory::tracker & tracker__, const std::string & name__, value_type * host__, const sycl::range<dimensions> & range__);
+	~tracked_buffer();
+public:
+	sycl::buffer<value_type, dimensions> & get()
+	{
+		return *__buffer;
+	}
+	std::size_t id() const
+	{
+		return __id;
+	}
+};
+
+class tracker
+{
+private:
+	class allocation_type
+	{
+	public:
+		std::string name;
+		kind_type kind;
+		std::size_t bytes;
+		bool host_data;			// buffer made from host memory
+		const void * pointer;		// usm
+		double allocated_ns, first_use_ns = -1, last_use_ns = -1, released_ns = -1;
+		std::string last_use;
+		bool on_host, on_device;	// valid copy of the data
+		bool device_resident = false, host_resident = false;
+		std::size_t h2d_copies = 0, d2h_copies = 0, explicit_copies = 0;
+	};
+	class sample_type
+	{
+	public:
+		double ns;
+		std::size_t device_bytes, host_bytes;
+	};
+private:
+	clock_type::time_point __start = clock_type::now();
+	std::vector<allocation_type> __allocations;
+	std::map<const void *, std::size_t> __usm;	// pointer -> allocation
+	std::vector<sample_type> __samples;
+	std::size_t __device_bytes = 0, __host_bytes = 0;
+	std::size_t __device_peak = 0, __host_peak = 0;
+	double __device_peak_ns = 0;
+private:
+	double now_ns() const
+	{
+		return std::chrono::duration<double, std::nano>(clock_type::now() - __start).count();
+	}
+	void sample(double ns__)
+	{
+		if (__device_bytes > __device_peak)
+		{
+			__device_peak = __device_bytes;
+			__device_peak_ns = ns__;
+		}
+		__host_peak = std::max(__host_peak, __host_bytes);
+		__samples.push_back({ns__, __device_bytes, __host_bytes});
+	}
+	void make_resident(allocation_type & allocation__, bool device__)
+	{
+		bool & resident = device__ ? allocation__.device_resident : allocation__.host_resident;
+		if (resident)
+			return;
+		resident = true;
+		(device__ ? __device_bytes : __host_bytes) += allocation__.bytes;
+	}
+	// One use by the device or the host, with the copy it implies.
+	void use(std::size_t id__, bool device__, bool read__, bool write__, bool no_init__, const std::string & name__)
+	{
+		auto & allocation = __allocations[id__];
+		const double ns = this->now_ns();
+		if (allocation.first_use_ns < 0)
+			allocation.first_use_ns = ns;
+		allocation.last_use_ns = ns;
+		allocation.last_use = name__;
+
+		if (allocation.kind == kind_type::usm_device || allocation.kind == kind_type::usm_host)
+			return;
+		bool & here = device__ ? allocation.on_device : allocation.on_host;
+		bool & there = device__ ? allocation.on_host : allocation.on_device;
+		// shared usm is counted once, as device memory
+		if (device__ || allocation.kind != kind_type::usm_shared)
+			this->make_resident(allocation, device__);
+		if ((read__ || (write__ && ! no_init__)) && ! here && there)
+			++(device__ ? allocation.h2d_copies : allocation.d2h_copies);
+		here = true;
+		if (write__)
+			there = false;
+		this->sample(ns);
+	}
+	std::size_t add(const std::string & name__, kind_type kind__, std::size_t bytes__, bool host_data__, const void * pointer__)
+	{
+		allocation_type allocation{name__, kind__, bytes__, host_data__, pointer__, this->now_ns()};
+		allocation.on_host = host_data__ || kind__ == kind_type::usm_host || kind__ == kind_type::usm_shared;
+		allocation.on_device = ! host_data__;
+		__allocations.push_back(allocation);
+		auto & added = __allocations.back();
+		if (host_data__ || kind__ == kind_type::usm_host)
+			this->make_resident(added, false);
+		if (kind__ == kind_type::usm_device || kind__ == kind_type::usm_shared)
+			this->make_resident(added, true);
+		if (pointer__ != nullptr)
+			__usm[pointer__] = __allocations.size() - 1;
+		this->sample(added.allocated_ns);
+		return __allocations.size() - 1;
+	}
+	static std::string megabytes(std::size_t bytes__)
+	{
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(2) << bytes__ / 1048576.0 << " MiB";
+		return out.str();
+	}
+	static const char * kind_name(kind_type kind__)
+	{
+		switch (kind__)
+		{
+		case kind_type::buffer: return "buffer";
+		case kind_type::usm_device: return "usm device";
+		case kind_type::usm_shared: return "usm shared";
+		case kind_type::usm_host: return "usm host";
+		}
+		return "";
+	}
+	std::size_t find(const void * pointer__) const
+	{
+		auto it = __usm.find(pointer__);
+		if (it == __usm.end())
+			throw std::invalid_argument{"gpu::memory::tracker: not a tracked usm pointer"};
+		return it->second;
+	}
+public:
+	static constexpr bool enabled = gpu::memory::enabled;
+
+	// used by tracked_buffer
+	std::size_t add_buffer(const std::string & name__, std::size_t bytes__, bool host_data__)
+	{
+		if constexpr (! enabled)
+			return 0;
+		return this->add(name__, kind_type::buffer, bytes__, host_data__, nullptr);
+	}
+	void release(std::size_t id__)
+	{
+		if constexpr (! enabled)
+			return;
+		auto & allocation = __allocations[id__];
+		allocation.released_ns = this->now_ns();
+		// buffer destruction writes device data back to host data
+		if (allocation.kind == kind_type::buffer && allocation.host_data && ! allocation.on_host)
+			++allocation.d2h_copies;
+		if (allocation.device_resident)
+			__device_bytes -= allocation.bytes;
+		if (allocation.host_resident)
+			__host_bytes -= allocation.bytes;
+		allocation.device_resident = allocation.host_resident = false;
+		if (allocation.pointer != nullptr)
+			__usm.erase(allocation.pointer);
+		this->sample(allocation.released_ns);
+	}
+
+	template <typename value_type>
+	value_type * malloc_device(std::size_t count__, sycl::queue & queue__, const std::string & name__)
+	{
+		value_type * pointer = sycl::malloc_device<value_type>(count__, queue__);
+		if constexpr (enabled)
+			if (pointer != nullptr)
+				this->add(name__, kind_type::usm_device, count__ * sizeof(value_type), false, pointer);
+		return pointer;
+	}
+	template <typename value_type>
+	value_type * malloc_shared(std::size_t count__, sycl::queue & queue__, const std::string & name__)
+	{
+		value_type * pointer = sycl::malloc_shared<value_type>(count__, queue__);
+		if constexpr (enabled)
+			if (pointer != nullptr)
+				this->add(name__, kind_type::usm_shared, count__ * sizeof(value_type), false, pointer);
+		return pointer;
+	}
+	template <typename value_type>
+	value_type * malloc_host(std::size_t count__, sycl::queue & queue__, const std::string & name__)
+	{
+		value_type * pointer = sycl::malloc_host<value_type>(count__, queue__);
+		if constexpr (enabled)
+			if (pointer != nullptr)
+				this->add(name__, kind_type::usm_host, count__ * sizeof(value_type), false, pointer);
+		return pointer;
+	}
+	void free(void * pointer__, sycl::queue & queue__)
+	{
+		if constexpr (enabled)
+			this->release(this->find(pointer__));
+		sycl::free(pointer__, queue__);
+	}
+
+	// For the use list of submit
+	template <typename value_type, int dimensions>
+	gpu::memory::use_type read(const tracked_buffer<value_type, dimensions> & buffer__) const
+	{
+		return {buffer__.id(), true, false};
+	}
+	template <typename value_type, int dimensions>
+	gpu::memory::use_type write(const tracked_buffer<value_type, dimensions> & buffer__) const
+	{
+		return {buffer__.id(), false, true};
+	}
+	template <typename value_type, int dimensions>
+	gpu::memory::use_type write(const tracked_buffer<value_type, dimensions> & buffer__, std::remove_cvref_t<decltype(sycl::no_init)>) const
+	{
+		return {buffer__.id(), false, true, true};
+	}
+	template <typename value_type, int dimensions>
+	gpu::memory::use_type read_write(const tracked_buffer<value_type, dimensions> & buffer__) const
+	{
+		return {buffer__.id(), true, true};
+	}
+	gpu::memory::use_type read(const void * pointer__) const
+	{
+		return {enabled ? this->find(pointer__) : 0, true, false};
+	}
+	gpu::memory::use_type write(const void * pointer__) const
+	{
+		return {enabled ? this->find(pointer__) : 0, false, true};
+	}
+	gpu::memory::use_type read_write(const void * pointer__) const
+	{
+		return {enabled ? this->find(pointer__) : 0, true, true};
+	}
+
+	template <typename command_group_type>
+	sycl::event submit(sycl::queue & queue__, const std::string & name__, std::initializer_list<gpu::memory::use_type> uses__, command_group_type && command_group__)
+	{
+		if constexpr (enabled)
+			for (const auto & use: uses__)
+				this->use(use.id, true, use.read, use.write, use.no_init, name__);
+		return queue__.submit(std::forward<command_group_type>(command_group__));
+	}
+
+	// usm data touched by host code
+	void host_use(const void * pointer__, bool write__, const std::string & name__)
+	{
+		if constexpr (enabled)
+			this->use(this->find(pointer__), false, true, write__, false, name__);
+	}
+
+	// buffer.get_host_access()
+	template <typename value_type, int dimensions>
+	sycl::host_accessor<value_type, dimensions> host_access(tracked_buffer<value_type, dimensions> & buffer__, const std::string & name__)
+	{
+		if constexpr (enabled)
+			this->use(buffer__.id(), false, true, true, false, name__);
+		return sycl::host_accessor<value_type, dimensions>{buffer__.get()};
+	}
+	// buffer.get_host_access(sycl::read_only) and the other mode tags
+	template <typename value_type, int dimensions, typename mode_tag_type>
+	auto host_access(tracked_buffer<value_type, dimensions> & buffer__, const std::string & name__, mode_tag_type mode_tag__)
+	{
+		constexpr bool write = ! std::is_same_v<mode_tag_type, std::remove_cvref_t<decltype(sycl::read_only)>>;
+		if constexpr (enabled)
+			this->use(buffer__.id(), false, true, write, false, name__);
+		return buffer__.get().get_host_access(mode_tag__);
+	}
+
+	// queue.memcpy between tracked (or untracked host) memory
+	sycl::event memcpy(sycl::queue & queue__, void * destination__, const void * source__, std::size_t bytes__, const std::string & name__)
+	{
+		if constexpr (enabled)
+		{
+			for (const void * pointer: {source__, static_cast<const void *>(destination__)})
+			{
+				if (auto it = __usm.find(pointer); it != __usm.end())
+				{
+					++__allocations[it->second].explicit_copies;
+					this->use(it->second, true, pointer == source__, pointer != source__, pointer != source__, name__);
+				}
+			}
+		}
+		return queue__.memcpy(destination__, source__, bytes__);
+	}
+
+	void write_summary(std::ostream & out__) const
+	{
+		if constexpr (! enabled)
+		{
+			out__ << "gpu::memory: compiled out, define HAPPY_MEMORY_TRACE to enable it." << std::endl;
+			return;
+		}
+		const double end_ns = this->now_ns();
+		out__ << std::setw(20) << std::left << "allocation" << std::right
+			<< std::setw(12) << "kind"
+			<< std::setw(14) << "size"
+			<< std::setw(12) << "alloc ms"
+			<< std::setw(12) << "first ms"
+			<< std::setw(12) << "last ms"
+			<< std::setw(12) << "free ms"
+			<< std::setw(6) << "h2d"
+			<< std::setw(6) << "d2h"
+			<< std::setw(6) << "copy" << std::endl;
+		out__ << std::fixed << std::setprecision(3);
+		std::size_t h2d_bytes = 0, d2h_bytes = 0;
+		for (const auto & a: __allocations)
+		{
+			out__ << std::setw(20) << std::left << a.name << std::right
+				<< std::setw(12) << kind_name(a.kind)
+				<< std::setw(14) << megabytes(a.bytes)
+				<< std::setw(12) << a.allocated_ns * 1e-6
+				<< std::setw(12) << a.first_use_ns * 1e-6
+				<< std::setw(12) << a.last_use_ns * 1e-6;
+			if (a.released_ns < 0)
+				out__ << std::setw(12) << "alive";
+			else
+				out__ << std::setw(12) << a.released_ns * 1e-6;
+			out__ << std::setw(6) << a.h2d_copies << std::setw(6) << a.d2h_copies << std::setw(6) << a.explicit_copies << std::endl;
+			h2d_bytes += a.h2d_copies * a.bytes;
+			d2h_bytes += a.d2h_copies * a.bytes;
+		}
+		out__ << "\npeak device bytes: " << megabytes(__device_peak) << " at " << __device_peak_ns * 1e-6 << " ms"
+			<< "\npeak host bytes: " << megabytes(__host_peak)
+			<< "\nimplicit copies: host to device " << megabytes(h2d_bytes) << ", device to host " << megabytes(d2h_bytes) << "\n";
+
+		out__ << "\nsuggestions:\n";
+		std::size_t count = 0;
+		for (const auto & a: __allocations)
+		{
+			const double released = a.released_ns < 0 ? end_ns : a.released_ns;
+			if (a.last_use_ns < 0)
+			{
+				out__ << "  " << a.name << ": never used, " << megabytes(a.bytes) << " for nothing\n";
+				++count;
+			}
+			else if (a.last_use_ns < __device_peak_ns && __device_peak_ns < released && a.first_use_ns <= __device_peak_ns && a.kind != kind_type::usm_host)
+			{
+				out__ << "  " << a.name << ": idle at the device peak, release it after \"" << a.last_use
+					<< "\": peak - " << megabytes(a.bytes) << "\n";
+				++count;
+			}
+			if (a.kind == kind_type::buffer && a.h2d_copies + a.d2h_copies > 2)
+			{
+				out__ << "  " << a.name << ": " << a.h2d_copies + a.d2h_copies
+					<< " implicit copies, host and device take turns; keep it on one side\n";
+				++count;
+			}
+		}
+		// each allocation reuses at most one earlier allocation, and is reused at most once
+		std::vector<bool> reused(__allocations.size(), false);
+		for (std::size_t j=0; j<__allocations.size(); ++j)
+		{
+			const auto & later = __allocations[j];
+			for (std::size_t i=0; i<j; ++i)
+			{
+				const auto & earlier = __allocations[i];
+				if (reused[i] || earlier.last_use_ns < 0)
+					continue;
+				if (later.kind == earlier.kind && later.bytes <= earlier.bytes && later.allocated_ns > earlier.last_use_ns)
+				{
+					out__ << "  " << later.name << " can reuse the memory of " << earlier.name
+						<< " (unused since \"" << earlier.last_use << "\")\n";
+					reused[i] = true;
+					++count;
+					break;
+				}
+			}
+		}
+		if (count == 0)
+			out__ << "  none\n";
+		out__ << std::flush;
+	}
+
+	void write_timeline(std::ostream & out__) const
+	{
+		out__ << std::fixed << std::setprecision(3);
+		out__ << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+		out__ << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"gpu::memory\"}}";
+		if constexpr (enabled)
+		{
+			const double end_ns = this->now_ns();
+			for (const auto & s: __samples)
+			{
+				out__ << ",\n{\"name\":\"resident bytes\",\"ph\":\"C\",\"pid\":0,\"ts\":" << s.ns / 1000
+					<< ",\"args\":{\"device\":" << s.device_bytes << ",\"host\":" << s.host_bytes << "}}";
+			}
+			for (std::size_t i=0; i<__allocations.size(); ++i)
+			{
+				const auto & a = __allocations[i];
+				const double released = a.released_ns < 0 ? end_ns : a.released_ns;
+				out__ << ",\n{\"name\":\"" << gpu::trace::escape(a.name) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i + 1
+					<< ",\"ts\":" << a.allocated_ns / 1000
+					<< ",\"dur\":" << (released - a.allocated_ns) / 1000
+					<< ",\"args\":{\"kind\":\"" << kind_name(a.kind) << "\",\"bytes\":" << a.bytes
+					<< ",\"h2d\":" << a.h2d_copies << ",\"d2h\":" << a.d2h_copies << "}}";
+				if (a.last_use_ns >= 0 && a.last_use_ns < released)
+				{
+					out__ << ",\n{\"name\":\"idle\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i + 1
+						<< ",\"ts\":" << a.last_use_ns / 1000
+						<< ",\"dur\":" << (released - a.last_use_ns) / 1000 << "}";
+				}
+			}
+		}
+		out__ << "\n]}\n";
+	}
+};
+
+template <typename value_type, int dimensions>
+tracked_buffer<value_type, dimensions>::tracked_buffer(gpu::memory::tracker & tracker__, const std::string & name__, const sycl::range<dimensions> & range__):
+	__tracker{tracker__},
+	__id{tracker__.add_buffer(name__, range__.size() * sizeof(value_type), false)},
+	__buffer{std::in_place, range__}
+{
+}
+
+template <typename value_type, int dimensions>
+tracked_buffer<value_type, dimensions>::tracked_buffer(gpu::memory::tracker & tracker__, const std::string & name__, value_type * host__, const sycl::range<dimensions> & range__):
+	__tracker{tracker__},
+	__id{tracker__.add_buffer(name__, range__.size() * sizeof(value_type), true)},
+	__buffer{std::in_place, host__, range__}
+{
+}
+
+template <typename value_type, int dimensions>
+tracked_buffer<value_type, dimensions>::~tracked_buffer()
+{
+	__buffer.reset();
+	__tracker.release(__id);
+}
+
+}	// namespace gpu::memory
@@ -0,0 +1,318 @@
+//
+// Copyright (c) 2024 Fas Xmut (fasxmut at protonmail dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <sycl/sycl.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <map>
+#include <string>
+#include <chrono>
+#include <utility>
+
+// gpu::trace
+/*
+	Wraps queue.submit and buffer host access, and records:
+		+ kernel name, global range, local range, bytes moved
+		+ host enqueue time (the submit call) and blocking time of host access
+		+ device submit/start/end times from sycl event profiling
+
+	The records are written as a summary table, or as chrome trace json for
+	chrome://tracing and https://ui.perfetto.dev
+
+	submit takes the kernel_info as a callable, [&] { return make_info(...); },
+	called only when tracing is on.
+
+	Define HAPPY_TRACE to enable it. Without HAPPY_TRACE, gpu::trace::recorder
+	is an empty class whose members only forward to the queue and the buffer,
+	and the kernel_info callables are never called: no names, ranges or byte
+	counts are built at the call sites.
+*/
+
+namespace gpu::trace
+{
+
+// Sum of the sizes of all buffers__, in bytes.
+template <typename ... buffer_types>
+std::size_t bytes(const buffer_types & ... buffers__)
+{
+	return (std::size_t{0} + ... + buffers__.byte_size());
+}
+
+// text__ as the contents of a json string
+inline std::string escape(const std::string & text__)
+{
+	std::string out;
+	for (char c: text__)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+#ifdef HAPPY_TRACE
+
+class kernel_info
+{
+public:
+	std::string name;
+	std::array<std::size_t, 3> global{1, 1, 1};
+	std::array<std::size_t, 3> local{0, 0, 0};	// 0: no nd_range
+	std::size_t bytes = 0;
+};
+
+template <int dimensions>
+kernel_info make_info(std::string name__, const sycl::range<dimensions> & global__, std::size_t bytes__ = 0)
+{
+	kernel_info info{std::move(name__)};
+	for (int i=0; i<dimensions; ++i)
+		info.global[i] = global__[i];
+	info.bytes = bytes__;
+	return info;
+}
+
+template <int dimensions>
+kernel_info make_info(std::string name__, const sycl::nd_range<dimensions> & range__, std::size_t bytes__ = 0)
+{
+	kernel_info info = gpu::trace::make_info(std::move(name__), range__.get_global_range(), bytes__);
+	for (int i=0; i<dimensions; ++i)
+		info.local[i] = range__.get_local_range()[i];
+	return info;
+}
+
+class recorder
+{
+public:
+	using clock_type = std::chrono::steady_clock;
+private:
+	class record_type
+	{
+	public:
+		kernel_info info;
+		double enqueue_begin_ns, enqueue_end_ns;	// host, since recorder start
+		bool host_access;
+		sycl::event event;
+	};
+private:
+	clock_type::time_point __start = clock_type::now();
+	std::vector<record_type> __records;
+private:
+	double host_ns(clock_type::time_point time__) const
+	{
+		return std::chrono::duration<double, std::nano>(time__ - __start).count();
+	}
+	static std::string shape(const std::array<std::size_t, 3> & range__)
+	{
+		return std::to_string(range__[0]) + "x" + std::to_string(range__[1]) + "x" + std::to_string(range__[2]);
+	}
+	// Device [start, end] in host nanoseconds, or false if the queue has no profiling.
+	bool device_times(const record_type & record__, double offset__, double & start__, double & end__) const
+	{
+		try
+		{
+			start__ = record__.event.get_profiling_info<sycl::info::event_profiling::command_start>() + offset__;
+			end__ = record__.event.get_profiling_info<sycl::info::event_profiling::command_end>() + offset__;
+			return true;
+		}
+		catch (const sycl::exception &)
+		{
+			return false;
+		}
+	}
+	// device clock to host clock: line up the first device submit with its host enqueue.
+	double clock_offset() const
+	{
+		for (const auto & record: __records)
+		{
+			if (record.host_access)
+				continue;
+			try
+			{
+				return record.enqueue_begin_ns - record.event.get_profiling_info<sycl::info::event_profiling::command_submit>();
+			}
+			catch (const sycl::exception &)
+			{
+				return 0;
+			}
+		}
+		return 0;
+	}
+public:
+	static constexpr bool enabled = true;
+
+	// Queue properties needed for device times.
+	static sycl::property_list queue_properties()
+	{
+		return sycl::property_list{sycl::property::queue::enable_profiling{}};
+	}
+
+	template <typename info_maker_type, typename command_group_type>
+	sycl::event submit(sycl::queue & queue__, info_maker_type && make_info__, command_group_type && command_group__)
+	{
+		kernel_info info__ = std::forward<info_maker_type>(make_info__)();
+		auto begin = clock_type::now();
+		sycl::event event = queue__.submit(std::forward<command_group_type>(command_group__));
+		auto end = clock_type::now();
+		__records.push_back({std::move(info__), this->host_ns(begin), this->host_ns(end), false, event});
+		return event;
+	}
+
+	// buffer.get_host_access(), recording how long it blocks.
+	template <typename value_type, int dimensions>
+	sycl::host_accessor<value_type, dimensions> host_access(sycl::buffer<value_type, dimensions> & buffer__, std::string name__)
+	{
+		auto begin = clock_type::now();
+		sycl::host_accessor<value_type, dimensions> accessor{buffer__};
+		auto end = clock_type::now();
+		kernel_info info = gpu::trace::make_info(std::move(name__), buffer__.get_range(), buffer__.byte_size());
+		__records.push_back({std::move(info), this->host_ns(begin), this->host_ns(end), true, {}});
+		return accessor;
+	}
+
+	void write_chrome_trace(std::ostream & out__) const
+	{
+		sycl::event::wait(this->events());
+		const double offset = this->clock_offset();
+
+		out__ << std::fixed << std::setprecision(3);
+		out__ << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+		out__ << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"host\"}},\n";
+		out__ << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"device\"}}";
+		for (const auto & record: __records)
+		{
+			const auto & info = record.info;
+			const std::string args =
+				"{\"global\":\"" + shape(info.global) +
+				"\",\"local\":\"" + shape(info.local) +
+				"\",\"bytes\":" + std::to_string(info.bytes) + "}";
+
+			out__ << ",\n{\"name\":\"" << gpu::trace::escape((record.host_access ? "host_access " : "submit ") + info.name)
+				<< "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":" << record.enqueue_begin_ns / 1000
+				<< ",\"dur\":" << (record.enqueue_end_ns - record.enqueue_begin_ns) / 1000
+				<< ",\"args\":" << args << "}";
+
+			double start, end;
+			if (! record.host_access && this->device_times(record, offset, start, end))
+			{
+				out__ << ",\n{\"name\":\"" << gpu::trace::escape(info.name)
+					<< "\",\"ph\":\"X\",\"pid\":0,\"tid\":1,\"ts\":" << start / 1000
+					<< ",\"dur\":" << (end - start) / 1000
+					<< ",\"args\":" << args << "}";
+			}
+		}
+		out__ << "\n]}\n";
+	}
+
+	// Per name: calls, host time, device time, bytes and bandwidth.
+	void write_summary(std::ostream & out__) const
+	{
+		sycl::event::wait(this->events());
+
+		class total_type
+		{
+		public:
+			std::size_t calls = 0, bytes = 0;
+			double host_ns = 0, device_ns = 0;
+		};
+		std::map<std::string, total_type> totals;
+		for (const auto & record: __records)
+		{
+			auto & total = totals[(record.host_access ? "host_access " : "") + record.info.name];
+			++total.calls;
+			total.bytes += record.info.bytes;
+			total.host_ns += record.enqueue_end_ns - record.enqueue_begin_ns;
+			double start, end;
+			if (! record.host_access && this->device_times(record, 0, start, end))
+				total.device_ns += end - start;
+		}
+
+		out__ << std::setw(32) << std::left << "name" << std::right
+			<< std::setw(8) << "calls"
+			<< std::setw(14) << "host us"
+			<< std::setw(14) << "device us"
+			<< std::setw(14) << "bytes"
+			<< std::setw(12) << "GB/s" << std::endl;
+		out__ << std::fixed << std::setprecision(3);
+		for (const auto & [name, total]: totals)
+		{
+			const double ns = total.device_ns > 0 ? total.device_ns : total.host_ns;
+			out__ << std::setw(32) << std::left << name << std::right
+				<< std::setw(8) << total.calls
+				<< std::setw(14) << total.host_ns / 1000
+				<< std::setw(14) << total.device_ns / 1000
+				<< std::setw(14) << total.bytes
+				<< std::setw(12) << (ns > 0 ? total.bytes / ns : 0.0) << std::endl;
+		}
+	}
+
+	std::vector<sycl::event> events() const
+	{
+		std::vector<sycl::event> out;
+		for (const auto & record: __records)
+		{
+			if (! record.host_access)
+				out.push_back(record.event);
+		}
+		return out;
+	}
+};
+
+#else	// HAPPY_TRACE
+
+// Nothing is kept, so nothing is built: no strings, no ranges.
+class kernel_info
+{
+};
+
+template <typename ... argument_types>
+constexpr kernel_info make_info(const argument_types & ...)
+{
+	return {};
+}
+
+class recorder
+{
+public:
+	static constexpr bool enabled = false;
+
+	static sycl::property_list queue_properties()
+	{
+		return {};
+	}
+
+	template <typename info_maker_type, typename command_group_type>
+	sycl::event submit(sycl::queue & queue__, info_maker_type &&, command_group_type && command_group__)
+	{
+		return queue__.submit(std::forward<command_group_type>(command_group__));
+	}
+
+	template <typename value_type, int dimensions, typename name_type>
+	sycl::host_accessor<value_type, dimensions> host_access(sycl::buffer<value_type, dimensions> & buffer__, const name_type &)
+	{
+		return sycl::host_accessor<value_type, dimensions>{buffer__};
+	}
+
+	void write_chrome_trace(std::ostream & out__) const
+	{
+		out__ << "{\"traceEvents\":[]}\n";
+	}
+
+	void write_summary(std::ostream & out__) const
+	{
+		out__ << "gpu::trace: compiled out, define HAPPY_TRACE to enable it." << std::endl;
+	}
+};
+
+#endif	// HAPPY_TRACE
+
+}	// namespace gpu::trace
+